@@ -38,11 +38,14 @@
 #include "devicemanager.h"
 #include "effect.h"
 #include "effectmanager.h"
+#include "mediainfocache.h"
 #include "mediaobject.h"
+#include "metadatascanner.h"
 #include "sinknode.h"
 #include "utils/debug.h"
 #include "utils/libvlc.h"
 #include "utils/mime.h"
+#include "video/thumbnailer.h"
 #ifdef PHONON_EXPERIMENTAL
 #include "video/videodataoutput.h"
 #endif
@@ -140,12 +143,17 @@ Backend::Backend(QObject *parent, const QVariantList &)
     // Since VLC 2.2 PulseSupport is disabled since the "overlay" it implements clashes substantially with libvlc
     // internals. Instead VLC has full control.
 
+    // Created here so it lives in the GUI thread, scanners may use it from others.
+    MediaInfoCache::init();
+
     m_deviceManager = new DeviceManager(this);
     m_effectManager = new EffectManager(this);
 }
 
 Backend::~Backend()
 {
+    // Holds libVLC media, so it has to go first.
+    MediaInfoCache::shutdown();
     if (LibVLC::self)
         delete LibVLC::self;
     if (GlobalAudioChannels::self)
@@ -191,6 +199,20 @@ QObject *Backend::createObject(BackendInterface::Class c, QObject *parent, const
     return 0;
 }
 
+QObject *Backend::createThumbnailer(QObject *parent)
+{
+    if (!LibVLC::self || !pvlc_libvlc)
+        return 0;
+    return new Thumbnailer(parent);
+}
+
+QObject *Backend::createMetaDataScanner(QObject *parent)
+{
+    if (!LibVLC::self || !pvlc_libvlc)
+        return 0;
+    return new MetaDataScanner(parent);
+}
+
 QStringList Backend::availableMimeTypes() const
 {
     if (m_supportedMimeTypes.isEmpty())
@@ -89,6 +89,24 @@ public:
      */
     QObject *createObject(BackendInterface::Class, QObject *parent, const QList<QVariant> &args) override;
 
+    /**
+     * Creates a Thumbnailer, which is not part of the Phonon API and thus only
+     * reachable through the meta object of the backend.
+     *
+     * \param parent The object that will be the parent of the new object
+     * \return The thumbnailer or NULL if libVLC is not available.
+     */
+    Q_INVOKABLE QObject *createThumbnailer(QObject *parent);
+
+    /**
+     * Creates a MetaDataScanner, which is not part of the Phonon API and thus
+     * only reachable through the meta object of the backend.
+     *
+     * \param parent The object that will be the parent of the new object
+     * \return The scanner or NULL if libVLC is not available.
+     */
+    Q_INVOKABLE QObject *createMetaDataScanner(QObject *parent);
+
     /// \returns a list of all available mimetypes (hardcoded)
     QStringList availableMimeTypes() const override;
 
@@ -25,37 +25,85 @@
 #include "utils/libvlc.h"
 #include "utils/vstring.h"
 
+// Time in msec meta changes are gathered before being reported.
+#define META_DEBOUNCE 100
+
 namespace Phonon {
 namespace VLC {
 
+// Meta that maps straight to a Phonon key, see Media::patchMetaData() for the rest.
+static const struct {
+    libvlc_meta_t meta;
+    const char *key;
+} s_metaKeys[] = {
+    { libvlc_meta_Date, "DATE" },
+    { libvlc_meta_Genre, "GENRE" },
+    { libvlc_meta_TrackNumber, "TRACKNUMBER" },
+    { libvlc_meta_Description, "DESCRIPTION" },
+    { libvlc_meta_Copyright, "COPYRIGHT" },
+    { libvlc_meta_URL, "URL" },
+    { libvlc_meta_EncodedBy, "ENCODEDBY" }
+};
+static const int s_metaKeyCount = sizeof(s_metaKeys) / sizeof(*s_metaKeys);
+
+// Meta that ARTIST, ALBUM and TITLE get put together from.
+static const int s_artistAlbumTitleMeta = META_BIT(libvlc_meta_Artist) |
+                                          META_BIT(libvlc_meta_Album) |
+                                          META_BIT(libvlc_meta_Title) |
+                                          META_BIT(libvlc_meta_NowPlaying);
+
+static const libvlc_event_type_t s_events[] = {
+    libvlc_MediaMetaChanged,
+    libvlc_MediaSubItemAdded,
+    libvlc_MediaDurationChanged,
+    libvlc_MediaParsedChanged,
+    libvlc_MediaFreed,
+    libvlc_MediaStateChanged
+};
+static const int s_eventCount = sizeof(s_events) / sizeof(*s_events);
+
 Media::Media(const QByteArray &mrl, QObject *parent) :
+    Media(mrl, pvlc_libvlc, parent)
+{
+}
+
+Media::Media(const QByteArray &mrl, libvlc_instance_t *instance, QObject *parent) :
     QObject(parent),
-    m_media(libvlc_media_new_location(pvlc_libvlc, mrl.constData())),
+    m_instance(instance),
+    m_media(libvlc_media_new_location(instance, mrl.constData())),
     m_mrl(mrl)
 {
     Q_ASSERT(m_media);
+    libvlc_retain(m_instance);
+
+    m_metaTimer.setSingleShot(true);
+    m_metaTimer.setInterval(META_DEBOUNCE);
+    connect(&m_metaTimer, SIGNAL(timeout()), this, SLOT(emitMetaDataChanged()));
 
     libvlc_event_manager_t *manager = libvlc_media_event_manager(m_media);
-    libvlc_event_type_t events[] = {
-        libvlc_MediaMetaChanged,
-        libvlc_MediaSubItemAdded,
-        libvlc_MediaDurationChanged,
-        libvlc_MediaParsedChanged,
-        libvlc_MediaFreed,
-        libvlc_MediaStateChanged
-    };
-    const int eventCount = sizeof(events) / sizeof(*events);
-    for (int i = 0; i < eventCount; ++i) {
-        libvlc_event_attach(manager, events[i], event_cb, this);
+    for (int i = 0; i < s_eventCount; ++i) {
+        libvlc_event_attach(manager, s_events[i], event_cb, this);
     }
 }
 
 Media::~Media()
 {
     if (m_media) {
+        // The preparser or a player may hold on to the media for a while
+        // longer, they must not report to us anymore.
+        libvlc_event_manager_t *manager = libvlc_media_event_manager(m_media);
+        for (int i = 0; i < s_eventCount; ++i) {
+            libvlc_event_detach(manager, s_events[i], event_cb, this);
+        }
+#if (LIBVLC_VERSION_INT >= LIBVLC_VERSION(4, 0, 0, 0))
+        libvlc_media_parse_stop(m_instance, m_media);
+#else
+        libvlc_media_parse_stop(m_media);
+#endif
         libvlc_media_release(m_media);
         m_media = 0;
     }
+    libvlc_release(m_instance);
 }
 
 void Media::addOption(const QString &option)
@@ -82,19 +130,158 @@ void Media::event_cb(const libvlc_event_t *event, void *opaque)
                     Qt::QueuedConnection,
                     Q_ARG(qint64, event->u.media_duration_changed.new_duration));
         break;
-    case libvlc_MediaMetaChanged:
+    case libvlc_MediaMetaChanged: {
+        const int type = event->u.media_meta_changed.meta_type;
+        if (type >= 32)
+            break;
+        // Only the first change since the last report needs to get the timer
+        // going, the others merely add to the mask.
+        if (that->m_changedMeta.fetchAndOrOrdered(META_BIT(type)) == 0) {
+            QMetaObject::invokeMethod(
+                        &that->m_metaTimer, "start",
+                        Qt::QueuedConnection);
+        }
+        break;
+    }
+    case libvlc_MediaParsedChanged:
         QMetaObject::invokeMethod(
-                    that, "metaDataChanged",
-                    Qt::QueuedConnection);
+                    that, "parsed",
+                    Qt::QueuedConnection,
+                    Q_ARG(bool, event->u.media_parsed_changed.new_status == libvlc_media_parsed_status_done));
         break;
     case libvlc_MediaSubItemAdded:
-    case libvlc_MediaParsedChanged:
     case libvlc_MediaFreed:
     case libvlc_MediaStateChanged:
         break;
     }
 }
 
+QMultiMap<QString, QString> Media::metaData()
+{
+    QMultiMap<QString, QString> metaDataMap;
+    patchMetaData(&metaDataMap, ~0);
+    return metaDataMap;
+}
+
+static bool setMetaEntry(QMultiMap<QString, QString> *metaData, const char *key, const QString &value)
+{
+    const QString name = QLatin1String(key);
+    QMultiMap<QString, QString>::iterator it = metaData->find(name);
+    if (it != metaData->end() && it.value() == value)
+        return false;
+    metaData->replace(name, value);
+    return true;
+}
+
+bool Media::patchMetaData(QMultiMap<QString, QString> *metaData, int changedMeta)
+{
+    bool changed = false;
+
+    if (changedMeta & s_artistAlbumTitleMeta) {
+        const QString artist = meta(libvlc_meta_Artist);
+        const QString title = meta(libvlc_meta_Title);
+        const QString nowPlaying = meta(libvlc_meta_NowPlaying);
+
+        // Streams sometimes have the artist and title munged in nowplaying.
+        // With ALBUM = Title and TITLE = NowPlaying it will still show up nicely in Amarok.
+        if (artist.isEmpty() && !nowPlaying.isEmpty()) {
+            changed |= setMetaEntry(metaData, "ALBUM", title);
+            changed |= setMetaEntry(metaData, "TITLE", nowPlaying);
+        } else {
+            changed |= setMetaEntry(metaData, "ALBUM", meta(libvlc_meta_Album));
+            changed |= setMetaEntry(metaData, "TITLE", title);
+        }
+        changed |= setMetaEntry(metaData, "ARTIST", artist);
+    }
+
+    for (int i = 0; i < s_metaKeyCount; ++i) {
+        if (changedMeta & META_BIT(s_metaKeys[i].meta))
+            changed |= setMetaEntry(metaData, s_metaKeys[i].key, meta(s_metaKeys[i].meta));
+    }
+
+    return changed;
+}
+
+void Media::emitMetaDataChanged()
+{
+    const int changedMeta = m_changedMeta.fetchAndStoreOrdered(0);
+    if (changedMeta)
+        emit metaDataChanged(changedMeta);
+}
+
+void Media::trackCounts(int *audio, int *video, int *subtitle)
+{
+#if (LIBVLC_VERSION_INT >= LIBVLC_VERSION(4, 0, 0, 0))
+    const libvlc_track_type_t types[] = { libvlc_track_audio, libvlc_track_video, libvlc_track_text };
+    int *counts[] = { audio, video, subtitle };
+    for (int i = 0; i < 3; ++i) {
+        libvlc_media_tracklist_t *list = libvlc_media_get_tracklist(m_media, types[i]);
+        *counts[i] = list ? libvlc_media_tracklist_count(list) : 0;
+        if (list)
+            libvlc_media_tracklist_delete(list);
+    }
+#else
+    *audio = *video = *subtitle = 0;
+    libvlc_media_track_t **tracks = 0;
+    const unsigned count = libvlc_media_tracks_get(m_media, &tracks);
+    for (unsigned i = 0; i < count; ++i) {
+        switch (tracks[i]->i_type) {
+        case libvlc_track_audio:
+            ++*audio;
+            break;
+        case libvlc_track_video:
+            ++*video;
+            break;
+        case libvlc_track_text:
+            ++*subtitle;
+            break;
+        default:
+            break;
+        }
+    }
+    libvlc_media_tracks_release(tracks, count);
+#endif
+}
+
+qreal Media::sampleAspectRatio()
+{
+    unsigned num = 0;
+    unsigned den = 0;
+#if (LIBVLC_VERSION_INT >= LIBVLC_VERSION(4, 0, 0, 0))
+    libvlc_media_tracklist_t *list = libvlc_media_get_tracklist(m_media, libvlc_track_video);
+    if (list) {
+        if (libvlc_media_tracklist_count(list) > 0) {
+            const libvlc_media_track_t *track = libvlc_media_tracklist_at(list, 0);
+            num = track->video->i_sar_num;
+            den = track->video->i_sar_den;
+        }
+        libvlc_media_tracklist_delete(list);
+    }
+#else
+    libvlc_media_track_t **tracks = 0;
+    const unsigned count = libvlc_media_tracks_get(m_media, &tracks);
+    for (unsigned i = 0; i < count; ++i) {
+        if (tracks[i]->i_type == libvlc_track_video) {
+            num = tracks[i]->video->i_sar_num;
+            den = tracks[i]->video->i_sar_den;
+            break;
+        }
+    }
+    libvlc_media_tracks_release(tracks, count);
+#endif
+    return (num && den) ? qreal(num) / den : 1.0;
+}
+
+bool Media::startParsing(bool network, int timeout)
+{
+    const libvlc_media_parse_flag_t flags = network ? libvlc_media_parse_network : libvlc_media_parse_local;
+#if (LIBVLC_VERSION_INT >= LIBVLC_VERSION(4, 0, 0, 0))
+    return libvlc_media_parse_request(m_instance, m_media, flags, timeout) == 0;
+#else
+    return libvlc_media_parse_with_options(m_media, flags, timeout) == 0;
+#endif
+}
+
 void Media::setCdTrack(int track)
 {
     debug() << "setting CDDA track" << track;
@@ -18,8 +18,11 @@
 #ifndef PHONON_VLC_MEDIA_H
 #define PHONON_VLC_MEDIA_H
 
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMultiMap>
 #include <QtCore/QObject>
 #include <QtCore/QStringBuilder>
+#include <QtCore/QTimer>
 #include <QtCore/QVariant>
 
 #include <vlc/libvlc.h>
@@ -32,6 +35,7 @@
 
 #define INTPTR_PTR(x) reinterpret_cast<intptr_t>(x)
 #define INTPTR_FUNC(x) reinterpret_cast<intptr_t>(&x)
+#define META_BIT(x) (1 << (x))
 
 namespace Phonon {
 namespace VLC {
@@ -41,9 +45,16 @@ class Media : public QObject
     Q_OBJECT
 public:
     explicit Media(const QByteArray &mrl, QObject *parent = nullptr);
+
+    /**
+     * Creates the media in \p instance rather than the Backend's, which
+     * must stay valid until the media is gone.
+     */
+    Media(const QByteArray &mrl, libvlc_instance_t *instance, QObject *parent = nullptr);
     ~Media();
 
     inline libvlc_media_t *libvlc_media() const { return m_media; }
+    inline QByteArray mrl() const { return m_mrl; }
     inline operator libvlc_media_t *() const { return m_media; }
 
     inline void addOption(const QString &option, const QVariant &argument)
@@ -62,18 +73,74 @@ public:
 
     QString meta(libvlc_meta_t meta);
 
+    /**
+     * \returns the meta data of the media as Phonon expects it, e.g. to be
+     *          emitted by MediaObject::metaDataChanged()
+     */
+    QMultiMap<QString, QString> metaData();
+
+    /**
+     * Brings \p metaData, as returned by metaData(), up to date with only
+     * the entries depending on \p changedMeta fetched from libVLC.
+     *
+     * \param changedMeta META_BIT()s of the libvlc_meta_t that changed
+     * \returns \c true if any entry of \p metaData was changed
+     */
+    bool patchMetaData(QMultiMap<QString, QString> *metaData, int changedMeta);
+
+    /**
+     * Counts the elementary streams of the media by type, only meaningful once
+     * it has been parsed or played.
+     */
+    void trackCounts(int *audio, int *video, int *subtitle);
+
+    /**
+     * \returns the width to height ratio of the pixels of the first video
+     * track, 1 if unknown. Only meaningful once parsed or played.
+     */
+    qreal sampleAspectRatio();
+
     void setCdTrack(int track);
 
+    /**
+     * Starts parsing the media in the background, i.e. probing its format,
+     * duration and meta data, without playing it.
+     *
+     * \param network whether to parse network media as well
+     * \param timeout msec after which parsing gets aborted, -1 for VLC's default
+     * \returns \c false if parsing could not be started
+     *
+     * \see parsed()
+     */
+    bool startParsing(bool network, int timeout = -1);
+
 Q_SIGNALS:
     void durationChanged(qint64 duration);
-    void metaDataChanged();
+    /**
+     * Emitted at most every few msec, for all changes in between.
+     *
+     * \param changedMeta META_BIT()s of the libvlc_meta_t that changed
+     */
+    void metaDataChanged(int changedMeta);
+
+    /** Emitted when parsing ended, \p success is false if it failed or timed out */
+    void parsed(bool success);
+
+private Q_SLOTS:
+    void emitMetaDataChanged();
 
 private:
     static void event_cb(const libvlc_event_t *event, void *opaque);
 
+    /// Referenced for as long as the media exists, the Backend may go first.
+    libvlc_instance_t *m_instance;
     libvlc_media_t *m_media;
     libvlc_state_t m_state;
     QByteArray m_mrl;
+
+    /// META_BIT()s of the meta changed since metaDataChanged() was last emitted.
+    QAtomicInt m_changedMeta;
+    QTimer m_metaTimer;
 };
 
 } // namespace VLC
@@ -0,0 +1,215 @@
+/*
+    Copyright (C) 2026 vlc-phonon AUTHORS <kde-multimedia@kde.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mediainfocache.h"
+
+#include <QtCore/QFileInfo>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+#include <QtCore/QUrl>
+
+#include "utils/debug.h"
+#include "media.h"
+
+// Number of media kept in the cache.
+#define CACHE_SIZE 4096
+// Number of media parsed at the same time.
+#define PARSE_BUDGET 2
+// Time in msec after which parsing a media is given up.
+#define PARSE_TIMEOUT 5000
+
+namespace Phonon {
+namespace VLC {
+
+MediaInfo MediaInfo::fromMedia(Media *media)
+{
+    MediaInfo info;
+    info.duration = libvlc_media_get_duration(*media);
+    info.metaData = media->metaData();
+    media->trackCounts(&info.audioTracks, &info.videoTracks, &info.subtitleTracks);
+    return info;
+}
+
+QSharedPointer<MediaInfoCache> MediaInfoCache::s_instance;
+
+void MediaInfoCache::init()
+{
+    if (!s_instance) {
+        // Other threads may be the last to let go, the deletion has to
+        // happen in ours.
+        s_instance = QSharedPointer<MediaInfoCache>(new MediaInfoCache, &QObject::deleteLater);
+    }
+}
+
+void MediaInfoCache::shutdown()
+{
+    if (!s_instance)
+        return;
+    {
+        QMutexLocker lock(&s_instance->m_mutex);
+        s_instance->m_shutDown = true;
+        s_instance->m_queue.clear();
+        // They hold libVLC media, which must be gone before libVLC.
+        qDeleteAll(s_instance->m_parsing.keys());
+        s_instance->m_parsing.clear();
+    }
+    s_instance.clear();
+}
+
+QSharedPointer<MediaInfoCache> MediaInfoCache::instance()
+{
+    return s_instance;
+}
+
+MediaInfoCache::MediaInfoCache(QObject *parent)
+    : QObject(parent)
+    , m_shutDown(false)
+    , m_cache(CACHE_SIZE)
+{
+}
+
+MediaInfoCache::~MediaInfoCache()
+{
+    qDeleteAll(m_parsing.keys());
+}
+
+bool MediaInfoCache::lookup(const QByteArray &mrl, MediaInfo *info)
+{
+    QDateTime modified;
+    {
+        QMutexLocker lock(&m_mutex);
+        // object() also marks the entry as most recently used.
+        const Entry *entry = m_cache.object(mrl);
+        if (!entry)
+            return false;
+        modified = entry->modified;
+        *info = entry->info;
+    }
+    // Not holding the lock while asking the file system.
+    if (modified != modificationTime(mrl)) {
+        QMutexLocker lock(&m_mutex);
+        m_cache.remove(mrl);
+        return false;
+    }
+    return true;
+}
+
+void MediaInfoCache::request(const QByteArray &mrl)
+{
+    if (!mrl.startsWith("file://"))
+        return;
+    if (QThread::currentThread() != thread()) {
+        // The Media get created with us as parent, so only in our thread.
+        QMetaObject::invokeMethod(this, "request", Qt::QueuedConnection, Q_ARG(QByteArray, mrl));
+        return;
+    }
+    MediaInfo info;
+    if (lookup(mrl, &info))
+        return;
+
+    {
+        QMutexLocker lock(&m_mutex);
+        if (m_shutDown || m_queue.contains(mrl))
+            return;
+        foreach (const Media *media, m_parsing.keys()) {
+            if (media->mrl() == mrl)
+                return;
+        }
+        m_queue.enqueue(mrl);
+    }
+    startParsing();
+}
+
+void MediaInfoCache::onParsed(bool success)
+{
+    Media *media = qobject_cast<Media *>(sender());
+    QDateTime modified;
+    {
+        QMutexLocker lock(&m_mutex);
+        if (!media || !m_parsing.contains(media))
+            return;
+        modified = m_parsing.take(media);
+    }
+
+    const QByteArray mrl = media->mrl();
+    if (success) {
+        insert(mrl, modified, MediaInfo::fromMedia(media));
+    } else {
+        debug() << "parsing failed or timed out:" << mrl;
+    }
+    media->deleteLater();
+    startParsing();
+
+    if (success)
+        emit parsed(mrl);
+}
+
+void MediaInfoCache::insert(const QByteArray &mrl, const QDateTime &modified, const MediaInfo &info)
+{
+    if (!modified.isValid())
+        return;
+    Entry *entry = new Entry;
+    entry->modified = modified;
+    entry->info = info;
+    QMutexLocker lock(&m_mutex);
+    m_cache.insert(mrl, entry);
+}
+
+QDateTime MediaInfoCache::modificationTime(const QByteArray &mrl)
+{
+    return QFileInfo(QUrl::fromEncoded(mrl).toLocalFile()).lastModified();
+}
+
+void MediaInfoCache::startParsing()
+{
+    // Only ever runs in our thread, so nobody else takes from the queue
+    // while the lock is released.
+    bool skipped = true;
+    while (skipped) {
+        skipped = false;
+        QList<QByteArray> mrls;
+        {
+            QMutexLocker lock(&m_mutex);
+            while (!m_shutDown && m_parsing.size() + mrls.size() < PARSE_BUDGET && !m_queue.isEmpty())
+                mrls.append(m_queue.dequeue());
+        }
+
+        foreach (const QByteArray &mrl, mrls) {
+            // Taken before parsing, so a file modified meanwhile does not end
+            // up cached with stale information as if it were current. Not
+            // holding the lock while asking the file system.
+            const QDateTime modified = modificationTime(mrl);
+            if (!modified.isValid()) {
+                skipped = true;
+                continue;
+            }
+
+            Media *media = new Media(mrl, this);
+            connect(media, SIGNAL(parsed(bool)), this, SLOT(onParsed(bool)));
+            if (!media->startParsing(false, PARSE_TIMEOUT)) {
+                delete media;
+                skipped = true;
+                continue;
+            }
+            QMutexLocker lock(&m_mutex);
+            m_parsing.insert(media, modified);
+        }
+    }
+}
+
+} // namespace VLC
+} // namespace Phonon
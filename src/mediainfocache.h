@@ -0,0 +1,145 @@
+/*
+    Copyright (C) 2026 vlc-phonon AUTHORS <kde-multimedia@kde.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PHONON_VLC_MEDIAINFOCACHE_H
+#define PHONON_VLC_MEDIAINFOCACHE_H
+
+#include <QtCore/QCache>
+#include <QtCore/QDateTime>
+#include <QtCore/QHash>
+#include <QtCore/QMultiMap>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QQueue>
+#include <QtCore/QSharedPointer>
+
+namespace Phonon {
+namespace VLC {
+
+class Media;
+
+/// What parsing a media found out about it.
+struct MediaInfo
+{
+    MediaInfo()
+        : duration(-1)
+        , audioTracks(0)
+        , videoTracks(0)
+        , subtitleTracks(0)
+    {}
+
+    qint64 duration;
+    QMultiMap<QString, QString> metaData;
+    int audioTracks;
+    int videoTracks;
+    int subtitleTracks;
+
+    /// \returns the information of \p media, which must have been parsed
+    static MediaInfo fromMedia(Media *media);
+};
+
+/**
+ * \brief Parses local files in the background and caches what it found.
+ *
+ * MediaObject has neither duration nor meta data of a source until it gets
+ * played. With the cache they are there once loaded, right away for files
+ * seen before.
+ *
+ * Entries are kept least recently used first and keyed by MRL, an entry is
+ * only valid as long as the file has not been modified since. Only a few
+ * files get parsed at a time, each with a time limit, so loading long
+ * playlists does not flood VLC's preparser.
+ *
+ * The cache is created by the Backend in the GUI thread and parses there.
+ * lookup(), request() and insert() may be called from any thread, e.g. by a
+ * MetaDataScanner. Whoever uses the cache from another thread holds on to
+ * instance(), which keeps it alive past the Backend.
+ */
+class MediaInfoCache : public QObject
+{
+    Q_OBJECT
+public:
+    /// Creates the singleton in the calling thread, which parses.
+    static void init();
+
+    /**
+     * Aborts all parsing and drops the reference of the Backend, the cache
+     * itself stays around for as long as anyone else holds on to it.
+     * Must be called in the thread init() was called in.
+     */
+    static void shutdown();
+
+    /// \returns the singleton, null unless init() was called
+    static QSharedPointer<MediaInfoCache> instance();
+
+    ~MediaInfoCache();
+
+    /**
+     * \param mrl the MRL to look up
+     * \param info receives the cached information if there is any
+     * \returns \c true if there is a valid entry for \p mrl
+     */
+    bool lookup(const QByteArray &mrl, MediaInfo *info);
+
+    /**
+     * Queues \p mrl for parsing unless it is cached, queued or not a local
+     * file. parsed() is emitted once the information is available.
+     */
+    Q_INVOKABLE void request(const QByteArray &mrl);
+
+    /**
+     * Caches \p info for \p mrl, which was parsed when the file had been
+     * last modified at \p modified.
+     */
+    void insert(const QByteArray &mrl, const QDateTime &modified, const MediaInfo &info);
+
+    /// \returns the modification time of the file behind \p mrl, invalid if there is none
+    static QDateTime modificationTime(const QByteArray &mrl);
+
+Q_SIGNALS:
+    /// Emitted when \p mrl got parsed and is in the cache.
+    void parsed(const QByteArray &mrl);
+
+private Q_SLOTS:
+    void onParsed(bool success);
+
+private:
+    explicit MediaInfoCache(QObject *parent = nullptr);
+
+    struct Entry
+    {
+        QDateTime modified;
+        MediaInfo info;
+    };
+
+    void startParsing();
+
+    static QSharedPointer<MediaInfoCache> s_instance;
+
+    /// Guards all members below, parsing Media are only touched in our thread.
+    QMutex m_mutex;
+    bool m_shutDown;
+    QCache<QByteArray, Entry> m_cache;
+    QQueue<QByteArray> m_queue;
+    /// Media being parsed and the modification time of their files at the start.
+    QHash<Media *, QDateTime> m_parsing;
+};
+
+} // namespace VLC
+} // namespace Phonon
+
+#endif // PHONON_VLC_MEDIAINFOCACHE_H
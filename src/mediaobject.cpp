@@ -23,9 +23,12 @@
 #include "mediaobject.h"
 
 #include <QtCore/QDir>
+#include <QtCore/QFile>
 #include <QtCore/QStringBuilder>
 #include <QtCore/QUrl>
+#include <QtCore/QtMath>
 
+#include <phonon/abstractmediastream.h>
 #include <phonon/pulsesupport.h>
 
 #include <vlc/libvlc_version.h>
@@ -34,6 +37,7 @@
 #include "utils/debug.h"
 #include "utils/libvlc.h"
 #include "media.h"
+#include "mediainfocache.h"
 #include "sinknode.h"
 #include "streamreader.h"
 
@@ -41,6 +45,17 @@
 //2 seconds
 static const int ABOUT_TO_FINISH_TIME = 2000;
 
+// Interval in msec at which crossfade volumes get updated. VLC applies the
+// volume per audio buffer, which are in the same order of magnitude.
+#define CROSSFADE_STEP 20
+// Time in msec a crossfade waits at most for the video output of the
+// previous source to close before starting the next source regardless.
+#define CROSSFADE_VIDEO_TIMEOUT 1000
+// Time in msec before the end at which the next source gets pre-rolled on a
+// second player for a gapless transition. Must be short of
+// ABOUT_TO_FINISH_TIME, that is when the next source gets handed to us.
+#define PREROLL_TIME 1000
+
 namespace Phonon {
 namespace VLC {
 
@@ -50,8 +65,20 @@ MediaObject::MediaObject(QObject *parent)
     , m_streamReader(0)
     , m_state(Phonon::StoppedState)
     , m_tickInterval(0)
+    , m_tickTimer(new QTimer(this))
+    , m_fadingPlayer(0)
+    , m_crossfadeTimer(new QTimer(this))
+    , m_crossfadeWaitTimer(new QTimer(this))
+    , m_crossfadeDuration(0)
+    , m_switchingSource(false)
+    , m_sourceChangePending(false)
+    , m_stateDeferred(false)
+    , m_deferredState(MediaPlayer::NoState)
+    , m_prerolling(false)
     , m_transitionTime(0)
     , m_media(0)
+    , m_nextMedia(0)
+    , m_metaDataComplete(false)
 {
     qRegisterMetaType<QMultiMap<QString, QString> >("QMultiMap<QString, QString>");
 
@@ -60,13 +87,22 @@ MediaObject::MediaObject(QObject *parent)
     if (!m_player->libvlc_media_player())
         error() << "libVLC:" << LibVLC::errorMessage();
 
-    // Player signals.
-    connect(m_player, SIGNAL(seekableChanged(bool)), this, SIGNAL(seekableChanged(bool)));
-    connect(m_player, SIGNAL(timeChanged(qint64)), this, SLOT(timeChanged(qint64)));
-    connect(m_player, SIGNAL(stateChanged(MediaPlayer::State)), this, SLOT(updateState(MediaPlayer::State)));
-    connect(m_player, SIGNAL(hasVideoChanged(bool)), this, SLOT(onHasVideoChanged(bool)));
-    connect(m_player, SIGNAL(bufferChanged(int)), this, SLOT(setBufferStatus(int)));
-    connect(m_player, SIGNAL(timeChanged(qint64)), this, SLOT(timeChanged(qint64)));
+    connectPlayer();
+    connect(MediaInfoCache::instance().data(), SIGNAL(parsed(QByteArray)),
+            this, SLOT(onMediaInfoParsed(QByteArray)));
+
+    // Ticks are paced by a timer going off the player clock rather than by
+    // VLC's time reports, which come in at irregular intervals.
+    m_tickTimer->setSingleShot(true);
+    m_tickTimer->setTimerType(Qt::CoarseTimer);
+    connect(m_tickTimer, SIGNAL(timeout()), this, SLOT(onTickTimeout()));
+
+    m_crossfadeTimer->setInterval(CROSSFADE_STEP);
+    m_crossfadeTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_crossfadeTimer, SIGNAL(timeout()), this, SLOT(stepCrossfade()));
+    m_crossfadeWaitTimer->setSingleShot(true);
+    m_crossfadeWaitTimer->setInterval(CROSSFADE_VIDEO_TIMEOUT);
+    connect(m_crossfadeWaitTimer, SIGNAL(timeout()), this, SLOT(startFadeIn()));
 
     // Internal Signals.
     connect(this, SIGNAL(moveToNext()), SLOT(moveToNextSource()));
@@ -77,6 +113,8 @@ MediaObject::MediaObject(QObject *parent)
 
 MediaObject::~MediaObject()
 {
+    m_sourceChangePending = false;
+    finishCrossfade();
     unloadMedia();
     // Shutdown the pulseaudio mainloop before the MediaPlayer gets destroyed
     // (it is a child of the MO). There appears to be a peculiar race condition
@@ -137,6 +175,18 @@ void MediaObject::play()
 void MediaObject::pause()
 {
     DEBUG_BLOCK;
+    if (m_prerolling) {
+        // The next source gets paused already, it only needs to take over.
+        finishCrossfade();
+        return;
+    }
+    // The next source may not have been started yet, see startCrossfade().
+    const bool fadeInPending = m_crossfadeWaitTimer->isActive();
+    finishCrossfade();
+    if (fadeInPending) {
+        m_player->pausedPlay();
+        return;
+    }
     switch (m_state) {
     case BufferingState:
     case PlayingState:
@@ -158,6 +208,8 @@ void MediaObject::stop()
     if (m_streamReader)
         m_streamReader->unlock();
     m_nextSource = MediaSource(QUrl());
+    dropNextMedia();
+    finishCrossfade();
     m_player->stop();
 }
 
@@ -183,28 +235,24 @@ void MediaObject::seek(qint64 milliseconds)
     const qint64 time = currentTime();
     const qint64 total = totalTime();
 
-    // Reset last tick marker so we emit time even after seeking
-    if (time < m_lastTick)
-        m_lastTick = time;
+    // Tell right away where we are now and realign the ticks to it.
+    emitTick(time);
+    scheduleTick();
+
     if (time < total - m_prefinishMark)
         m_prefinishEmitted = false;
-    if (time < total - ABOUT_TO_FINISH_TIME)
+    if (time < total - aboutToFinishTime())
         m_aboutToFinishEmitted = false;
 }
 
-void MediaObject::timeChanged(qint64 time)
+void MediaObject::timeChanged(qint64 reportedTime)
 {
+    // The reported time is stale by the time it got dispatched, the clock is
+    // what currentTime() goes by as well.
+    Q_UNUSED(reportedTime);
+    const qint64 time = m_player->clockTime();
     const qint64 totalTime = m_totalTime;
 
-    switch (m_state) {
-    case PlayingState:
-    case BufferingState:
-    case PausedState:
-        emitTick(time);
-    default:
-        break;
-    }
-
     if (m_state == PlayingState || m_state == BufferingState) { // Buffering is concurrent
         if (time >= totalTime - m_prefinishMark) {
             if (!m_prefinishEmitted) {
@@ -213,19 +261,51 @@ void MediaObject::timeChanged(qint64 time)
             }
         }
         // Note that when the totalTime is <= 0 we cannot calculate any sane delta.
-        if (totalTime > 0 && time >= totalTime - ABOUT_TO_FINISH_TIME)
+        if (totalTime > 0 && time >= totalTime - aboutToFinishTime())
             emitAboutToFinish();
+        // Streams cannot be crossfaded, their reader goes with the source.
+        if (m_transitionTime < 0 && totalTime > 0 && time >= totalTime + m_transitionTime &&
+                !m_fadingPlayer && !m_streamReader && hasNextTrack())
+            startCrossfade();
+        // Likewise without a transition, the next source gets opened ahead
+        // of time and only needs to be unpaused once this one ended. Video
+        // would show up before its time, so only for audio.
+        if (m_transitionTime == 0 && totalTime > 0 && time >= totalTime - PREROLL_TIME &&
+                !m_fadingPlayer && !m_streamReader && !m_hasVideo && hasNextTrack())
+            startPreroll();
     }
 }
 
 void MediaObject::emitTick(qint64 time)
 {
-    if (m_tickInterval == 0) // Make sure we do not ever emit ticks when deactivated.\]
+    if (m_tickInterval == 0) // Make sure we do not ever emit ticks when deactivated.
+        return;
+    // Nothing to tell while the clock stands (e.g. VLC stalling).
+    if (time == m_lastTick)
+        return;
+    m_lastTick = time;
+    emit tick(time);
+}
+
+void MediaObject::onTickTimeout()
+{
+    emitTick(clockPlayer()->clockTime());
+    scheduleTick();
+}
+
+void MediaObject::scheduleTick()
+{
+    if (m_tickInterval <= 0 || (m_state != PlayingState && m_state != BufferingState)) {
+        m_tickTimer->stop();
         return;
-    if (time + m_tickInterval >= m_lastTick) {
-        m_lastTick = time;
-        emit tick(time);
     }
+
+    // Aim for the next multiple of the interval, so neither timer latency
+    // nor seeking makes the ticks drift. Coarse timers may fire a little
+    // early, a boundary less than a quarter interval away counts as reached.
+    const qint64 time = clockPlayer()->clockTime();
+    const qint64 next = ((time + m_tickInterval / 4) / m_tickInterval + 1) * m_tickInterval;
+    m_tickTimer->start(int(next - time));
 }
 
 void MediaObject::loadMedia(const QByteArray &mrl)
@@ -237,7 +317,9 @@ void MediaObject::loadMedia(const QByteArray &mrl)
     // until we play it.
     // FIXME: libvlc should really allow for this as it can cause unexpected delay
     // even though the GUI might indicate that playback should start right away.
-    changeState(Phonon::LoadingState);
+    // A crossfade keeps playing throughout, see startCrossfade().
+    if (!m_switchingSource)
+        changeState(Phonon::LoadingState);
 
     m_mrl = mrl;
     debug() << "loading encoded:" << m_mrl;
@@ -246,7 +328,32 @@ void MediaObject::loadMedia(const QByteArray &mrl)
     // is expected to go to loading state and then at some point reach stopped,
     // at which point playback can be started.
     // See state enum documentation for more information.
-    changeState(Phonon::StoppedState);
+    if (!m_switchingSource)
+        changeState(Phonon::StoppedState);
+
+    // Without parsing, duration and meta data would only become known once
+    // playing. Files seen before have them right away, others get parsed in
+    // the background.
+    if (!applyCachedMediaInfo() && MediaInfoCache::instance())
+        MediaInfoCache::instance()->request(m_mrl);
+}
+
+bool MediaObject::applyCachedMediaInfo()
+{
+    const QSharedPointer<MediaInfoCache> cache = MediaInfoCache::instance();
+    MediaInfo info;
+    if (!cache || !cache->lookup(m_mrl, &info))
+        return false;
+    if (info.duration > 0 && info.duration != m_totalTime)
+        updateDuration(info.duration);
+    setMetaData(info.metaData);
+    return true;
+}
+
+void MediaObject::onMediaInfoParsed(const QByteArray &mrl)
+{
+    if (mrl == m_mrl)
+        applyCachedMediaInfo();
 }
 
 void MediaObject::loadMedia(const QString &mrl)
@@ -266,6 +373,7 @@ qint32 MediaObject::tickInterval() const
 void MediaObject::setTickInterval(qint32 interval)
 {
     m_tickInterval = interval;
+    scheduleTick();
 }
 
 qint64 MediaObject::currentTime() const
@@ -276,7 +384,7 @@ qint64 MediaObject::currentTime() const
     case Phonon::PausedState:
     case Phonon::BufferingState:
     case Phonon::PlayingState:
-        time = m_player->time();
+        time = clockPlayer()->clockTime();
         break;
     case Phonon::StoppedState:
     case Phonon::LoadingState:
@@ -305,6 +413,45 @@ MediaSource MediaObject::source() const
     return m_mediaSource;
 }
 
+/**
+ * \returns the MRL for a LocalFile or Url source, resolving relative paths
+ *          against the current directory.
+ */
+static QByteArray urlToMrl(const QUrl &sourceUrl)
+{
+    QByteArray url;
+    if (sourceUrl.scheme().isEmpty()) {
+        url = "file://";
+        // QUrl considers url.scheme.isEmpty() == url.isRelative(),
+        // so to be sure the url is not actually absolute we just
+        // check the first character
+        if (!sourceUrl.toString().startsWith('/'))
+            url.append(QFile::encodeName(QDir::currentPath()) + '/');
+    }
+    url += sourceUrl.toEncoded();
+    return url;
+}
+
+/**
+ * \returns the name of the local file a stream source wraps, or an empty
+ *          string if it is not a plain file.
+ */
+static QString streamFileName(const MediaSource &source)
+{
+    // MediaSource(QIODevice *) wraps the device in an internal IODeviceStream
+    // which is parented to the device. Anything else is an application stream
+    // we have to drive through the StreamInterface.
+    const AbstractMediaStream *stream = source.stream();
+    if (!stream || !stream->inherits("Phonon::IODeviceStream")) {
+        return QString();
+    }
+    const QFile *file = qobject_cast<const QFile *>(stream->parent());
+    if (!file || file->isSequential()) {
+        return QString();
+    }
+    return file->fileName();
+}
+
 void MediaObject::setSource(const MediaSource &source)
 {
     DEBUG_BLOCK;
@@ -336,15 +483,7 @@ void MediaObject::setSource(const MediaSource &source)
     case MediaSource::LocalFile:
     case MediaSource::Url:
         debug() << "MediaSource::Url:" << source.url();
-        if (source.url().scheme().isEmpty()) {
-            url = "file://";
-            // QUrl considers url.scheme.isEmpty() == url.isRelative(),
-            // so to be sure the url is not actually absolute we just
-            // check the first character
-            if (!source.url().toString().startsWith('/'))
-                url.append(QFile::encodeName(QDir::currentPath()) + '/');
-        }
-        url += source.url().toEncoded();
+        url = urlToMrl(source.url());
         loadMedia(url);
         break;
     case MediaSource::Disc:
@@ -411,20 +550,33 @@ void MediaObject::setSource(const MediaSource &source)
         }
         break;
     }
-    case MediaSource::Stream:
-        m_streamReader = new StreamReader(this);
+    case MediaSource::Stream: {
+        m_streamReader = new StreamReader(source, this);
         // LibVLC refuses to emit seekability as it does a try-and-seek approach
         // to work around this we exchange the player's seekability signal
         // for the readers
         // https://bugs.kde.org/show_bug.cgi?id=293012
         connect(m_streamReader, SIGNAL(streamSeekableChanged(bool)), this, SIGNAL(seekableChanged(bool)));
         disconnect(m_player, SIGNAL(seekableChanged(bool)), this, SIGNAL(seekableChanged(bool)));
-        // Only connect now to avoid seekability detection before we are connected.
-        m_streamReader->connectToSource(source);
+        // Streams of demuxed packets go straight to the decoders. Streams that
+        // merely wrap a local file get served from a memory mapping, saving
+        // all the copying through writeData().
+        const bool packetized = m_streamReader->setElementaryStreamFormat(source.stream());
+        const QString fileName = packetized ? QString() : streamFileName(source);
+        if (fileName.isEmpty() || !m_streamReader->mapFile(fileName)) {
+            // Only connect now to avoid seekability detection before we are connected.
+            m_streamReader->connectToSource(source);
+        }
         loadMedia(QByteArray("imem://"));
         break;
     }
+    }
 
+    if (m_switchingSource) {
+        // Still playing out the previous source, see finishCrossfade().
+        m_sourceChangePending = true;
+        return;
+    }
     debug() << "Sending currentSourceChanged";
     emit currentSourceChanged(m_mediaSource);
 }
@@ -434,6 +586,7 @@ void MediaObject::setNextSource(const MediaSource &source)
     DEBUG_BLOCK;
     debug() << source.url();
     m_nextSource = source;
+    prefetchNextMedia();
     // This function is not ever called by the consumer but only libphonon.
     // Furthermore libphonon only calls this function in its aboutToFinish slot,
     // iff sources are already in the queue. In case our aboutToFinish was too
@@ -468,6 +621,165 @@ void MediaObject::setTransitionTime(qint32 time)
     m_transitionTime = time;
 }
 
+qint64 MediaObject::aboutToFinishTime() const
+{
+    return ABOUT_TO_FINISH_TIME + qMax<qint32>(0, -m_transitionTime);
+}
+
+void MediaObject::connectPlayer()
+{
+    connect(m_player, SIGNAL(seekableChanged(bool)), this, SIGNAL(seekableChanged(bool)));
+    connect(m_player, SIGNAL(timeChanged(qint64)), this, SLOT(timeChanged(qint64)));
+    connect(m_player, SIGNAL(stateChanged(MediaPlayer::State)), this, SLOT(updateState(MediaPlayer::State)));
+    connect(m_player, SIGNAL(hasVideoChanged(bool)), this, SLOT(onHasVideoChanged(bool)));
+    connect(m_player, SIGNAL(bufferChanged(int)), this, SLOT(setBufferStatus(int)));
+}
+
+bool MediaObject::moveToNextPlayer()
+{
+    // The current player keeps playing, but only its sound matters from now
+    // on. Video cannot be mixed, the sinks move over to the next source.
+    // Detaching them first keeps the video output of the previous player from
+    // being set up with them again.
+    MediaPlayer *previous = m_player;
+    previous->disconnect();
+    const QList<SinkNode *> sinks = m_sinks;
+    foreach (SinkNode *sink, sinks) {
+        sink->disconnectFromMediaObject(this);
+    }
+    const bool hadVideo = previous->hasVideoOutput();
+    previous->disableVideo();
+
+    m_player = new MediaPlayer(this);
+    connectPlayer();
+    // Audio outputs only apply a volume that was set explicitly, the next
+    // source must play at the volume of the previous one.
+    m_player->setAudioVolume(previous->audioVolume());
+    foreach (SinkNode *sink, sinks) {
+        sink->connectToMediaObject(this);
+    }
+
+    m_fadingPlayer = previous;
+    m_stateDeferred = false;
+
+    // Like moveToNextSource(), but playback goes on, so neither the states
+    // of loading a source nor, until the switch is done, the source change.
+    m_switchingSource = true;
+    setSource(m_nextSource);
+    m_switchingSource = false;
+    m_nextSource = MediaSource(QUrl());
+    setupMedia();
+
+    return hadVideo;
+}
+
+void MediaObject::startCrossfade()
+{
+    DEBUG_BLOCK;
+    debug() << "crossfading over" << -m_transitionTime << "msec";
+
+    MediaPlayer *previous = m_player;
+    const bool hadVideo = moveToNextPlayer();
+    m_crossfadeDuration = -m_transitionTime;
+    m_player->setAudioFade(0.0);
+
+    if (hadVideo) {
+        // Closing the video output is asynchronous, until it did it keeps
+        // drawing into the video sinks the next source is about to use.
+        connect(previous, SIGNAL(hasVideoChanged(bool)),
+                this, SLOT(onFadingVideoChanged(bool)));
+        m_crossfadeWaitTimer->start();
+    } else {
+        startFadeIn();
+    }
+}
+
+void MediaObject::startPreroll()
+{
+    DEBUG_BLOCK;
+
+    MediaPlayer *previous = m_player;
+    m_prerolling = true;
+    moveToNextPlayer();
+    connect(previous, SIGNAL(stateChanged(MediaPlayer::State)),
+            this, SLOT(onFadingStateChanged(MediaPlayer::State)));
+    m_player->pausedPlay();
+}
+
+void MediaObject::onFadingStateChanged(MediaPlayer::State state)
+{
+    if (!m_prerolling || sender() != m_fadingPlayer)
+        return;
+    switch (state) {
+    case MediaPlayer::EndedState:
+    case MediaPlayer::ErrorState:
+    case MediaPlayer::StoppedState:
+        break;
+    default:
+        return;
+    }
+
+    debug() << "switching over to the pre-rolled source";
+    // Its pausing is no state of ours, resuming reports playing again.
+    // An error is for finishCrossfade() to apply though.
+    if (!m_stateDeferred || m_deferredState != MediaPlayer::ErrorState) {
+        m_stateDeferred = false;
+        if (!m_player->play())
+            error() << "libVLC:" << LibVLC::errorMessage();
+    }
+    finishCrossfade();
+}
+
+void MediaObject::onFadingVideoChanged(bool hasVideo)
+{
+    if (!hasVideo && sender() == m_fadingPlayer)
+        startFadeIn();
+}
+
+void MediaObject::startFadeIn()
+{
+    if (!m_fadingPlayer || m_crossfadeTimer->isActive())
+        return;
+    m_crossfadeWaitTimer->stop();
+    if (!m_player->play())
+        error() << "libVLC:" << LibVLC::errorMessage();
+    m_crossfadeTimer->start();
+}
+
+void MediaObject::stepCrossfade()
+{
+    // Go by the clock of the next source, it only runs once that actually
+    // plays, so its start never gets faded over with silence.
+    const qreal progress = qBound<qreal>(0.0, qreal(m_player->clockTime()) / m_crossfadeDuration, 1.0);
+    m_player->setAudioFade(qSin(progress * M_PI_2));
+    if (m_fadingPlayer)
+        m_fadingPlayer->setAudioFade(qCos(progress * M_PI_2));
+    if (progress >= 1.0 || m_state == ErrorState)
+        finishCrossfade();
+}
+
+void MediaObject::finishCrossfade()
+{
+    m_crossfadeTimer->stop();
+    m_crossfadeWaitTimer->stop();
+    if (!m_fadingPlayer)
+        return;
+    m_prerolling = false;
+    m_player->setAudioFade(1.0);
+    m_fadingPlayer->stopAndDelete();
+    m_fadingPlayer = 0;
+
+    if (m_sourceChangePending) {
+        m_sourceChangePending = false;
+        debug() << "Sending currentSourceChanged";
+        emit currentSourceChanged(m_mediaSource);
+    }
+    if (m_stateDeferred) {
+        m_stateDeferred = false;
+        updateState(m_deferredState);
+    }
+}
+
 void MediaObject::emitAboutToFinish()
 {
     if (!m_aboutToFinishEmitted) {
@@ -503,6 +815,8 @@ void MediaObject::changeState(Phonon::State newState)
     // State changed
     Phonon::State previousState = m_state;
     m_state = newState;
+    // Ticks are suspended while not playing.
+    scheduleTick();
     emit stateChanged(m_state, previousState);
 }
 
@@ -528,6 +842,31 @@ inline bool MediaObject::hasNextTrack()
     return m_nextSource.type() != MediaSource::Invalid && m_nextSource.type() != MediaSource::Empty;
 }
 
+void MediaObject::prefetchNextMedia()
+{
+    dropNextMedia();
+
+    // Parsing a remote source would open a connection of its own, those
+    // only get opened once, see startPreroll().
+    if (m_nextSource.type() != MediaSource::LocalFile)
+        return;
+
+    m_nextMrl = urlToMrl(m_nextSource.url());
+    debug() << "prefetching" << m_nextMrl;
+    m_nextMedia = new Media(m_nextMrl, this);
+    if (!m_nextMedia->startParsing(false))
+        debug() << "could not start parsing" << m_nextMrl;
+}
+
+void MediaObject::dropNextMedia()
+{
+    if (m_nextMedia) {
+        m_nextMedia->deleteLater();
+        m_nextMedia = 0;
+    }
+    m_nextMrl.clear();
+}
+
 inline void MediaObject::unloadMedia()
 {
     if (m_media) {
@@ -544,8 +883,17 @@ void MediaObject::setupMedia()
     unloadMedia();
     resetMembers();
 
-    // Create a media with the given MRL
-    m_media = new Media(m_mrl, this);
+    // Create a media with the given MRL, unless it got prefetched already
+    // while the previous source was still playing. Options are only applied
+    // below, parsing does not need them and sinks may have changed since.
+    const bool prefetched = m_nextMedia && m_nextMrl == m_mrl;
+    if (prefetched) {
+        m_media = m_nextMedia;
+        m_nextMedia = 0;
+    } else {
+        m_media = new Media(m_mrl, this);
+    }
+    dropNextMedia();
 
     if (m_isScreen) {
         m_media->addOption(QLatin1String("screen-fps=24.0"));
@@ -587,11 +935,24 @@ void MediaObject::setupMedia()
         sink->addToMedia(m_media);
     }
 
+    // What we have is from another media until it gets replaced as a whole.
+    m_metaDataComplete = false;
+
     // Connect to Media signals. Disconnection is done at unloading.
     connect(m_media, SIGNAL(durationChanged(qint64)),
             this, SLOT(updateDuration(qint64)));
-    connect(m_media, SIGNAL(metaDataChanged()),
-            this, SLOT(updateMetaData()));
+    connect(m_media, SIGNAL(metaDataChanged(int)),
+            this, SLOT(updateMetaData(int)));
+    if (prefetched) {
+        // Parsing may well have reported before we got connected.
+        const qint64 duration = libvlc_media_get_duration(*m_media);
+        if (duration > 0)
+            updateDuration(duration);
+        updateMetaData();
+    } else {
+        // Resetting members forgot what we knew from loading.
+        applyCachedMediaInfo();
+    }
 
     // Update available audio channels/subtitles/angles/chapters/etc...
     // i.e everything from MediaController
@@ -636,33 +997,21 @@ void MediaObject::updateDuration(qint64 newDuration)
     emit totalTimeChanged(m_totalTime);
 }
 
-void MediaObject::updateMetaData()
+void MediaObject::updateMetaData(int changedMeta)
 {
-    QMultiMap<QString, QString> metaDataMap;
-
-    const QString artist = m_media->meta(libvlc_meta_Artist);
-    const QString title = m_media->meta(libvlc_meta_Title);
-    const QString nowPlaying = m_media->meta(libvlc_meta_NowPlaying);
-
-    // Streams sometimes have the artist and title munged in nowplaying.
-    // With ALBUM = Title and TITLE = NowPlaying it will still show up nicely in Amarok.
-    if (artist.isEmpty() && !nowPlaying.isEmpty()) {
-        metaDataMap.insert(QLatin1String("ALBUM"), title);
-        metaDataMap.insert(QLatin1String("TITLE"), nowPlaying);
-    } else {
-        metaDataMap.insert(QLatin1String("ALBUM"), m_media->meta(libvlc_meta_Album));
-        metaDataMap.insert(QLatin1String("TITLE"), title);
+    if (!m_metaDataComplete) {
+        setMetaData(m_media->metaData());
+        return;
     }
+    // Streams change their meta a lot, e.g. NowPlaying with every song, so
+    // only what changed gets fetched and patched in.
+    if (m_media->patchMetaData(&m_vlcMetaData, changedMeta))
+        emit metaDataChanged(m_vlcMetaData);
+}
 
-    metaDataMap.insert(QLatin1String("ARTIST"), artist);
-    metaDataMap.insert(QLatin1String("DATE"), m_media->meta(libvlc_meta_Date));
-    metaDataMap.insert(QLatin1String("GENRE"), m_media->meta(libvlc_meta_Genre));
-    metaDataMap.insert(QLatin1String("TRACKNUMBER"), m_media->meta(libvlc_meta_TrackNumber));
-    metaDataMap.insert(QLatin1String("DESCRIPTION"), m_media->meta(libvlc_meta_Description));
-    metaDataMap.insert(QLatin1String("COPYRIGHT"), m_media->meta(libvlc_meta_Copyright));
-    metaDataMap.insert(QLatin1String("URL"), m_media->meta(libvlc_meta_URL));
-    metaDataMap.insert(QLatin1String("ENCODEDBY"), m_media->meta(libvlc_meta_EncodedBy));
-
+void MediaObject::setMetaData(const QMultiMap<QString, QString> &metaDataMap)
+{
+    m_metaDataComplete = true;
     if (metaDataMap == m_vlcMetaData) {
         // No need to issue any change, the data is the same
         return;
@@ -678,6 +1027,18 @@ void MediaObject::updateState(MediaPlayer::State state)
     debug() << state;
     debug() << "attempted autoplay?" << m_attemptingAutoplay;
 
+    if (m_fadingPlayer) {
+        // A pre-rolled source waits for the previous one to end in any case.
+        if (m_prerolling || (state != MediaPlayer::ErrorState && state != MediaPlayer::EndedState)) {
+            // The previous source is still playing, the next one loading or
+            // buffering only matters once it took over.
+            m_deferredState = state;
+            m_stateDeferred = true;
+            return;
+        }
+        finishCrossfade();
+    }
+
     if (m_attemptingAutoplay) {
         switch (state) {
         case MediaPlayer::PlayingState:
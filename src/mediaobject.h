@@ -228,7 +228,7 @@ private Q_SLOTS:
     void changeState(Phonon::State newState);
 
     /**
-     * Checks when the tick(), prefinishMarkReached(), aboutToFinish() signals need to
+     * Checks when the prefinishMarkReached(), aboutToFinish() signals need to
      * be emitted and emits them if necessary.
      *
      * \param currentTime The current play time for the media, in milliseconds.
@@ -236,6 +236,21 @@ private Q_SLOTS:
     void timeChanged(qint64 time);
     void emitTick(qint64 time);
 
+    /** Emits the tick due and schedules the next one. */
+    void onTickTimeout();
+
+    /** Ramps the volumes of the crossfading players, see startCrossfade(). */
+    void stepCrossfade();
+
+    /** Starts the fade in once the video output of the fading player closed. */
+    void onFadingVideoChanged(bool hasVideo);
+
+    /** Starts playing the next source of a crossfade, unless it already plays. */
+    void startFadeIn();
+
+    /** Lets a pre-rolled source take over once the fading player ended. */
+    void onFadingStateChanged(MediaPlayer::State state);
+
     /**
      * If the next media source is valid, the current source is replaced and playback is commenced.
      * The next source is set to an empty source.
@@ -247,8 +262,16 @@ private Q_SLOTS:
     /*** Update media duration time - see comment in CPP */
     void updateDuration(qint64 newDuration);
 
-    /** Retrieve meta data of a file (i.e ARTIST, TITLE, ALBUM, etc...). */
-    void updateMetaData();
+    /**
+     * Retrieve meta data of a file (i.e ARTIST, TITLE, ALBUM, etc...).
+     *
+     * \param changedMeta META_BIT()s of the libvlc_meta_t to refresh, only
+     *        meaningful once the meta data of the media is known as a whole
+     */
+    void updateMetaData(int changedMeta = ~0);
+
+    /** Applies cached information once the MediaInfoCache parsed \p mrl. */
+    void onMediaInfoParsed(const QByteArray &mrl);
     void updateState(MediaPlayer::State state);
 
     /** Called when the availability of video output changed */
@@ -282,6 +305,72 @@ private:
 
     bool hasNextTrack();
 
+    /**
+     * Builds the Media of the next source and starts parsing it, so its
+     * duration and meta data are known as soon as it becomes current.
+     * Only local files are prefetched.
+     */
+    void prefetchNextMedia();
+
+    /** Drops the Media prefetched for the next source, if any. */
+    void dropNextMedia();
+
+    /** Emits metaDataChanged() unless \p metaDataMap is what we have already. */
+    void setMetaData(const QMultiMap<QString, QString> &metaDataMap);
+
+    /**
+     * Fills duration and meta data from the MediaInfoCache.
+     * \returns \c false if there is nothing cached for the current MRL
+     */
+    bool applyCachedMediaInfo();
+
+    /** Connects the signals of m_player we are interested in. */
+    void connectPlayer();
+
+    /**
+     * \returns how long before the end aboutToFinish() gets emitted, which
+     * is when libphonon hands us the next source. Crossfades need it early
+     * enough to start the next source transitionTime() before the end.
+     */
+    qint64 aboutToFinishTime() const;
+
+    /**
+     * Sets up the next source on a new player and moves all sinks over, while
+     * the current player becomes m_fadingPlayer to play out its end.
+     * \returns whether the current player had a video output
+     */
+    bool moveToNextPlayer();
+
+    /**
+     * Starts the next source on a new player while the current one plays out
+     * its end. The volumes of both get ramped over -transitionTime() msec
+     * with equal power curves.
+     */
+    void startCrossfade();
+
+    /**
+     * Opens the next source on a new player paused, so it only needs to be
+     * unpaused once the current one ended. Gapless playback for a
+     * transitionTime() of 0.
+     */
+    void startPreroll();
+
+    /** \returns the player currentTime() and ticks go by. */
+    MediaPlayer *clockPlayer() const { return m_prerolling ? m_fadingPlayer : m_player; }
+
+    /**
+     * Tears down the player faded out, if any, and emits the
+     * currentSourceChanged() and the state held back during the fade.
+     */
+    void finishCrossfade();
+
+    /**
+     * (Re)starts the tick timer for the next multiple of the tick interval
+     * according to the player clock, or stops it when no ticks are due
+     * (i.e. not playing or ticks disabled).
+     */
+    void scheduleTick();
+
     /**
      * Changes the current state to buffering and sets the new current file.
      *
@@ -316,13 +405,36 @@ private:
 
     qint32 m_tickInterval;
     qint64 m_lastTick;
+    QTimer *m_tickTimer;
+
+    /** Player playing out the previous source during a crossfade. */
+    MediaPlayer *m_fadingPlayer;
+    QTimer *m_crossfadeTimer;
+    /** Runs while the next source waits for the fading video to close. */
+    QTimer *m_crossfadeWaitTimer;
+    qint32 m_crossfadeDuration;
+    /** Set while setSource() is called for a crossfade, see startCrossfade(). */
+    bool m_switchingSource;
+    /** Whether currentSourceChanged() is due once the crossfade is done. */
+    bool m_sourceChangePending;
+    /** The last state of the next source held back during the fade, if any. */
+    bool m_stateDeferred;
+    MediaPlayer::State m_deferredState;
+    /** Whether m_player pre-rolls the next source, see startPreroll(). */
+    bool m_prerolling;
     qint32 m_transitionTime;
 
     Media *m_media;
 
+    /** Media prefetched for the next source and its MRL, see prefetchNextMedia() */
+    Media *m_nextMedia;
+    QByteArray m_nextMrl;
+
     qint64 m_totalTime;
     QByteArray m_mrl;
     QMultiMap<QString, QString> m_vlcMetaData;
+    /** Whether m_vlcMetaData is that of m_media, so changes can be patched in. */
+    bool m_metaDataComplete;
     QList<SinkNode *> m_sinks;
 
     bool m_hasVideo;
@@ -20,8 +20,10 @@
 #include <QtCore/QDebug>
 #include <QtCore/QDir>
 #include <QtCore/QMetaType>
+#include <QtCore/QStandardPaths>
 #include <QtCore/QString>
 #include <QtCore/QTemporaryFile>
+#include <QtCore/QThreadPool>
 #include <QtGui/QImage>
 
 #include <vlc/libvlc_version.h>
@@ -31,22 +33,93 @@
 
 // Callbacks come from a VLC thread. In some cases Qt fails to detect this and
 // tries to invoke directly (i.e. from same thread). This can lead to thread
-// pollution throughout Phonon, which is very much not desired.
+// pollution throughout Phonon, which is very much not desired. So signals are
+// only ever posted, through postOrdered() which also keeps them in the order
+// VLC raised them in.
 #define P_EMIT_HAS_VIDEO(hasVideo) \
-    QMetaObject::invokeMethod(\
-        that, "hasVideoChanged", \
-        Qt::QueuedConnection, \
-        Q_ARG(bool, hasVideo))
+    that->postOrdered([that]() { emit that->hasVideoChanged(hasVideo); })
 
 #define P_EMIT_STATE(__state) \
-    QMetaObject::invokeMethod(\
-        that, "stateChanged", \
-        Qt::QueuedConnection, \
-        Q_ARG(MediaPlayer::State, __state))
+    that->postOrdered([that]() { emit that->stateChanged(__state); })
+
+// Events coalesced into one dispatch, see MediaPlayer::postEvents().
+#define PENDING_TIME 0x1
+#define PENDING_LENGTH 0x2
+#define PENDING_BUFFER 0x4
+#define PENDING_ORDERED 0x8
+
+// Upper bound for the clock to run on past the last time VLC reported, so it
+// does not run away while VLC stalls (e.g. buffering without a state change).
+#define CLOCK_MAX_EXTRAPOLATION 1000
+// Time in msec after a seek during which VLC may still report from before it.
+#define CLOCK_SEEK_WINDOW 2000
+// Distance in msec from the seek target within which a report is taken as
+// being from after the seek, VLC lands on keyframes before the target.
+#define CLOCK_SEEK_TOLERANCE 5000
 
 namespace Phonon {
 namespace VLC {
 
+static const libvlc_event_type_t s_events[] = {
+    libvlc_MediaPlayerMediaChanged,
+    libvlc_MediaPlayerNothingSpecial,
+    libvlc_MediaPlayerOpening,
+    libvlc_MediaPlayerBuffering,
+    libvlc_MediaPlayerPlaying,
+    libvlc_MediaPlayerPaused,
+    libvlc_MediaPlayerStopped,
+    libvlc_MediaPlayerForward,
+    libvlc_MediaPlayerBackward,
+    libvlc_MediaPlayerEndReached,
+    libvlc_MediaPlayerEncounteredError,
+    libvlc_MediaPlayerTimeChanged,
+    libvlc_MediaPlayerPositionChanged,
+    libvlc_MediaPlayerSeekableChanged,
+    libvlc_MediaPlayerPausableChanged,
+    libvlc_MediaPlayerTitleChanged,
+    libvlc_MediaPlayerSnapshotTaken,
+    libvlc_MediaPlayerLengthChanged,
+    libvlc_MediaPlayerVout,
+    libvlc_MediaPlayerCorked,
+    libvlc_MediaPlayerUncorked,
+    libvlc_MediaPlayerMuted,
+    libvlc_MediaPlayerUnmuted,
+    libvlc_MediaPlayerAudioVolume
+};
+static const int s_eventCount = sizeof(s_events) / sizeof(*s_events);
+
+/**
+ * Stops and releases a libVLC player on a pool thread. Stopping joins the
+ * input thread, which can take a while, e.g. for network streams.
+ */
+class PlayerReleaser : public QRunnable
+{
+public:
+    /// Takes over the reference to \p player.
+    PlayerReleaser(libvlc_media_player_t *player, const std::function<void ()> &cleanUp)
+        : m_player(player)
+        , m_cleanUp(cleanUp)
+    {
+    }
+
+    void run() override
+    {
+#if (LIBVLC_VERSION_INT >= LIBVLC_VERSION(4, 0, 0, 0))
+        // Releasing the last reference waits for the stop to complete.
+        libvlc_media_player_stop_async(m_player);
+#else
+        libvlc_media_player_stop(m_player);
+#endif
+        libvlc_media_player_release(m_player);
+        if (m_cleanUp)
+            m_cleanUp();
+    }
+
+private:
+    libvlc_media_player_t *m_player;
+    std::function<void ()> m_cleanUp;
+};
+
 MediaPlayer::MediaPlayer(QObject *parent)
     : QObject(parent)
     , m_media(0)
@@ -54,41 +127,27 @@ MediaPlayer::MediaPlayer(QObject *parent)
     , m_doingPausedPlay(false)
     , m_volume(75)
     , m_fadeAmount(1.0f)
+    , m_latestTime(0)
+    , m_latestLength(0)
+    , m_latestBuffer(0)
+    , m_pendingEvents(0)
+    , m_clockSequence(0)
+    , m_clockBase(0)
+    , m_clockStamp(0)
+    , m_clockFloor(0)
+    , m_clockRunning(0)
+    , m_clockSeekTarget(-1)
+    , m_clockSeekStamp(-1)
 {
+    m_clockTimer.start();
+
     Q_ASSERT(m_player);
 
     qRegisterMetaType<MediaPlayer::State>("MediaPlayer::State");
 
     libvlc_event_manager_t *manager = libvlc_media_player_event_manager(m_player);
-    libvlc_event_type_t events[] = {
-        libvlc_MediaPlayerMediaChanged,
-        libvlc_MediaPlayerNothingSpecial,
-        libvlc_MediaPlayerOpening,
-        libvlc_MediaPlayerBuffering,
-        libvlc_MediaPlayerPlaying,
-        libvlc_MediaPlayerPaused,
-        libvlc_MediaPlayerStopped,
-        libvlc_MediaPlayerForward,
-        libvlc_MediaPlayerBackward,
-        libvlc_MediaPlayerEndReached,
-        libvlc_MediaPlayerEncounteredError,
-        libvlc_MediaPlayerTimeChanged,
-        libvlc_MediaPlayerPositionChanged,
-        libvlc_MediaPlayerSeekableChanged,
-        libvlc_MediaPlayerPausableChanged,
-        libvlc_MediaPlayerTitleChanged,
-        libvlc_MediaPlayerSnapshotTaken,
-        libvlc_MediaPlayerLengthChanged,
-        libvlc_MediaPlayerVout,
-        libvlc_MediaPlayerCorked,
-        libvlc_MediaPlayerUncorked,
-        libvlc_MediaPlayerMuted,
-        libvlc_MediaPlayerUnmuted,
-        libvlc_MediaPlayerAudioVolume
-    };
-    const int eventCount = sizeof(events) / sizeof(*events);
-    for (int i = 0; i < eventCount; ++i) {
-        libvlc_event_attach(manager, events[i], event_cb, this);
+    for (int i = 0; i < s_eventCount; ++i) {
+        libvlc_event_attach(manager, s_events[i], event_cb, this);
     }
 
     // Deactivate video title overlay (i.e. name of the video displaying
@@ -99,11 +158,32 @@ MediaPlayer::MediaPlayer(QObject *parent)
 
 MediaPlayer::~MediaPlayer()
 {
-    libvlc_media_player_release(m_player);
+    if (m_player)
+        libvlc_media_player_release(m_player);
 }
 
+void MediaPlayer::stopAndDelete(const std::function<void ()> &cleanUp)
+{
+    // Nobody is interested in what the player is up to anymore, detaching
+    // also guarantees VLC does not call into us after deletion.
+    disconnect();
+    libvlc_event_manager_t *manager = libvlc_media_player_event_manager(m_player);
+    for (int i = 0; i < s_eventCount; ++i) {
+        libvlc_event_detach(manager, s_events[i], event_cb, this);
+    }
+
+    // The releaser takes over our reference, dropping the last one here
+    // would block.
+    QThreadPool::globalInstance()->start(new PlayerReleaser(m_player, cleanUp));
+    m_player = 0;
+    // May well be called from a slot connected to one of our signals.
+    deleteLater();
+}
+
+
 void MediaPlayer::setMedia(Media *media)
 {
+    updateClock(0, 0);
     m_media = media;
     libvlc_media_player_set_media(m_player, *m_media);
 }
@@ -160,11 +240,86 @@ qint64 MediaPlayer::time() const
     return libvlc_media_player_get_time(m_player);
 }
 
-void MediaPlayer::setTime(qint64 newTime)
+qint64 MediaPlayer::clockTime() const
 {
+    qint64 base;
+    qint64 stamp;
+    qint64 floor;
+    int running;
+    int sequence;
+    do {
+        sequence = m_clockSequence.loadAcquire();
+        base = m_clockBase.loadAcquire();
+        stamp = m_clockStamp.loadAcquire();
+        floor = m_clockFloor.loadAcquire();
+        running = m_clockRunning.loadAcquire();
+        // Retry if an update was in progress or happened in between.
+    } while ((sequence & 1) || m_clockSequence.loadAcquire() != sequence);
+
+    if (!running)
+        return qMax(floor, base);
+    const qint64 elapsed = (m_clockTimer.nsecsElapsed() - stamp) / 1000000;
+    return qMax(floor, base + qBound<qint64>(0, elapsed, CLOCK_MAX_EXTRAPOLATION));
+}
+
+void MediaPlayer::updateClock(qint64 time, int running, bool monotonic)
+{
+    QMutexLocker lock(&m_clockMutex);
+    const qint64 current = clockTime();
+    if (time < 0)
+        time = current;
+    if (running < 0)
+        running = m_clockRunning.loadRelaxed();
+    // VLC's reports lag behind the extrapolation, while playing the time
+    // stands still until the new base catches up rather than going back.
+    const qint64 floor = (monotonic && running) ? current : time;
+
+    m_clockSequence.fetchAndAddOrdered(1);
+    m_clockBase.storeRelaxed(time);
+    m_clockStamp.storeRelaxed(m_clockTimer.nsecsElapsed());
+    m_clockFloor.storeRelaxed(floor);
+    m_clockRunning.storeRelaxed(running);
+    m_clockSequence.fetchAndAddRelease(1);
+}
+
+void MediaPlayer::seekClock(qint64 target)
+{
+    QMutexLocker lock(&m_clockMutex);
+    m_clockSeekTarget = target;
+    m_clockSeekStamp = m_clockTimer.nsecsElapsed();
+}
+
+void MediaPlayer::reportClockTime(qint64 time)
+{
+    bool monotonic = true;
+    {
+        QMutexLocker lock(&m_clockMutex);
+        if (m_clockSeekStamp >= 0) {
+            if ((m_clockTimer.nsecsElapsed() - m_clockSeekStamp) / 1000000 > CLOCK_SEEK_WINDOW) {
+                m_clockSeekStamp = -1;
+            } else if (m_clockSeekTarget < 0 || qAbs(time - m_clockSeekTarget) <= CLOCK_SEEK_TOLERANCE) {
+                // Possibly where the seek landed, later reports correct it.
+                monotonic = false;
+            } else {
+                // Still from before the seek.
+                return;
+            }
+        }
+    }
+    updateClock(time, -1, monotonic);
+}
+
+void MediaPlayer::setTime(qint64 newTime, bool fast)
+{
+    // Seeking is asynchronous, but for all intents and purposes we are there.
+    // Where VLC actually lands may well be earlier, e.g. on a keyframe.
+    updateClock(newTime);
+    seekClock(newTime);
+
 #if (LIBVLC_VERSION_INT >= LIBVLC_VERSION(4, 0, 0, 0))
-    libvlc_media_player_set_time(m_player, newTime, false /* not fast, but precise */);
+    libvlc_media_player_set_time(m_player, newTime, fast);
 #else
+    Q_UNUSED(fast);
     libvlc_media_player_set_time(m_player, newTime);
 #endif
 }
@@ -194,17 +349,25 @@ bool MediaPlayer::setSubtitle(const QString &file)
 
 void MediaPlayer::setTitle(int title)
 {
+    seekClock(-1);
     libvlc_media_player_set_title(m_player, title);
 }
 
 void MediaPlayer::setChapter(int chapter)
 {
+    seekClock(-1);
     libvlc_media_player_set_chapter(m_player, chapter);
 }
 
 QImage MediaPlayer::snapshot() const
 {
-    QTemporaryFile tempFile(QDir::tempPath() % QDir::separator() % QStringLiteral("phonon-vlc-snapshot"));
+    // libVLC can only write snapshots to files. The runtime directory is
+    // generally backed by memory, so prefer it over a temporary directory
+    // that may well be on disk.
+    QString directory = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation);
+    if (directory.isEmpty())
+        directory = QDir::tempPath();
+    QTemporaryFile tempFile(directory % QDir::separator() % QStringLiteral("phonon-vlc-snapshot"));
     tempFile.open();
 
     // This function is sync.
@@ -219,6 +382,11 @@ bool MediaPlayer::setAudioTrack(int track)
     return libvlc_audio_set_track(m_player, track) == 0;
 }
 
+void MediaPlayer::disableVideo()
+{
+    libvlc_video_set_track(m_player, -1);
+}
+
 void MediaPlayer::event_cb(const libvlc_event_t *event, void *opaque)
 {
     MediaPlayer *that = reinterpret_cast<MediaPlayer *>(opaque);
@@ -227,34 +395,30 @@ void MediaPlayer::event_cb(const libvlc_event_t *event, void *opaque)
     // Do not forget to register for the events you want to handle here!
     switch (event->type) {
     case libvlc_MediaPlayerTimeChanged:
-        QMetaObject::invokeMethod(
-                    that, "timeChanged",
-                    Qt::QueuedConnection,
-                    Q_ARG(qint64, event->u.media_player_time_changed.new_time));
+        that->reportClockTime(event->u.media_player_time_changed.new_time);
+        that->m_latestTime.storeRelease(event->u.media_player_time_changed.new_time);
+        that->postEvents(PENDING_TIME);
         break;
-    case libvlc_MediaPlayerSeekableChanged:
-        QMetaObject::invokeMethod(
-                    that, "seekableChanged",
-                    Qt::QueuedConnection,
-                    Q_ARG(bool, event->u.media_player_seekable_changed.new_seekable));
+    case libvlc_MediaPlayerSeekableChanged: {
+        const bool seekable = event->u.media_player_seekable_changed.new_seekable;
+        that->postOrdered([that, seekable]() { emit that->seekableChanged(seekable); });
         break;
+    }
     case libvlc_MediaPlayerLengthChanged:
-        QMetaObject::invokeMethod(
-                    that, "lengthChanged",
-                    Qt::QueuedConnection,
-                    Q_ARG(qint64, event->u.media_player_length_changed.new_length));
+        that->m_latestLength.storeRelease(event->u.media_player_length_changed.new_length);
+        that->postEvents(PENDING_LENGTH);
         break;
     case libvlc_MediaPlayerNothingSpecial:
+        that->updateClock(0, 0);
         P_EMIT_STATE(NoState);
         break;
     case libvlc_MediaPlayerOpening:
+        that->updateClock(0, 0);
         P_EMIT_STATE(OpeningState);
         break;
     case libvlc_MediaPlayerBuffering:
-        QMetaObject::invokeMethod(
-                    that, "bufferChanged",
-                    Qt::QueuedConnection,
-                    Q_ARG(int, event->u.media_player_buffering.new_cache));
+        that->m_latestBuffer.storeRelease(event->u.media_player_buffering.new_cache);
+        that->postEvents(PENDING_BUFFER);
         break;
     case libvlc_MediaPlayerPlaying:
         // Intercept state change and apply pausing once playing.
@@ -273,19 +437,25 @@ void MediaPlayer::event_cb(const libvlc_event_t *event, void *opaque)
             } else {
                 QMetaObject::invokeMethod(that, "stop", Qt::QueuedConnection);
             }
-        } else
+        } else {
+            that->updateClock(-1, 1);
             P_EMIT_STATE(PlayingState);
+        }
         break;
     case libvlc_MediaPlayerPaused:
+        that->updateClock(-1, 0);
         P_EMIT_STATE(PausedState);
         break;
     case libvlc_MediaPlayerStopped:
+        that->updateClock(0, 0);
         P_EMIT_STATE(StoppedState);
         break;
     case libvlc_MediaPlayerEndReached:
+        that->updateClock(-1, 0);
         P_EMIT_STATE(EndedState);
         break;
     case libvlc_MediaPlayerEncounteredError:
+        that->updateClock(-1, 0);
         P_EMIT_STATE(ErrorState);
         break;
     case libvlc_MediaPlayerVout:
@@ -304,23 +474,16 @@ void MediaPlayer::event_cb(const libvlc_event_t *event, void *opaque)
         that->play();
         break;
     case libvlc_MediaPlayerMuted:
-        QMetaObject::invokeMethod(
-                    that, "mutedChanged",
-                    Qt::QueuedConnection,
-                    Q_ARG(bool, true));
+        that->postOrdered([that]() { emit that->mutedChanged(true); });
         break;
     case libvlc_MediaPlayerUnmuted:
-        QMetaObject::invokeMethod(
-                    that, "mutedChanged",
-                    Qt::QueuedConnection,
-                    Q_ARG(bool, false));
+        that->postOrdered([that]() { emit that->mutedChanged(false); });
         break;
-    case libvlc_MediaPlayerAudioVolume:
-        QMetaObject::invokeMethod(
-                    that, "volumeChanged",
-                    Qt::QueuedConnection,
-                    Q_ARG(float, event->u.media_player_audio_volume.volume));
+    case libvlc_MediaPlayerAudioVolume: {
+        const float volume = event->u.media_player_audio_volume.volume;
+        that->postOrdered([that, volume]() { emit that->volumeChanged(volume); });
         break;
+    }
     case libvlc_MediaPlayerForward:
     case libvlc_MediaPlayerBackward:
     case libvlc_MediaPlayerPositionChanged:
@@ -335,6 +498,50 @@ void MediaPlayer::event_cb(const libvlc_event_t *event, void *opaque)
     }
 }
 
+void MediaPlayer::postEvents(int events)
+{
+    // Time and buffering events come in many times a second, posting each of
+    // them would flood the event loop with as many queued calls per player.
+    // Only the first event since the last dispatch posts one, later events
+    // merely update the values that dispatch is going to pick up.
+    if (m_pendingEvents.fetchAndOrOrdered(events) == 0)
+        QMetaObject::invokeMethod(this, "dispatchEvents", Qt::QueuedConnection);
+}
+
+void MediaPlayer::postOrdered(const std::function<void ()> &emitter)
+{
+    {
+        QMutexLocker lock(&m_orderedMutex);
+        m_orderedEvents.append(emitter);
+    }
+    postEvents(PENDING_ORDERED);
+}
+
+void MediaPlayer::dispatchEvents()
+{
+    // Clear first, events from now on post another dispatch.
+    const int pending = m_pendingEvents.fetchAndStoreOrdered(0);
+
+    // Values first, they mostly were reported before the state changes
+    // (e.g. the final time before the end was reached).
+    if (pending & PENDING_LENGTH)
+        emit lengthChanged(m_latestLength.loadAcquire());
+    if (pending & PENDING_TIME)
+        emit timeChanged(m_latestTime.loadAcquire());
+    if (pending & PENDING_BUFFER)
+        emit bufferChanged(m_latestBuffer.loadAcquire());
+
+    if (pending & PENDING_ORDERED) {
+        QVector<std::function<void ()> > events;
+        {
+            QMutexLocker lock(&m_orderedMutex);
+            events.swap(m_orderedEvents);
+        }
+        for (const std::function<void ()> &emitter : events)
+            emitter();
+    }
+}
+
 QDebug operator<<(QDebug dbg, const MediaPlayer::State &s)
 {
     QString name;
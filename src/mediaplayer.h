@@ -18,13 +18,19 @@
 #ifndef PHONON_VLC_MEDIAPLAYER_H
 #define PHONON_VLC_MEDIAPLAYER_H
 
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QMutex>
 #include <QObject>
 #include <QSharedPointer>
 #include <QSize>
+#include <QVector>
 
 #include <vlc/libvlc_version.h>
 #include <vlc/vlc.h>
 
+#include <functional>
+
 class QImage;
 class QString;
 
@@ -86,6 +92,13 @@ public:
     explicit MediaPlayer(QObject *parent = nullptr);
     ~MediaPlayer();
 
+    /**
+     * Stops playback without blocking and deletes the player later on. The
+     * libVLC player is stopped and released on a pool thread, which then
+     * invokes \p cleanUp, e.g. to delete video callbacks it still used.
+     */
+    void stopAndDelete(const std::function<void ()> &cleanUp = std::function<void ()>());
+
     inline libvlc_media_player_t *libvlc_media_player() const { return m_player; }
     inline operator libvlc_media_player_t *() const { return m_player; }
 
@@ -108,7 +121,20 @@ public:
 
     qint64 length() const;
     qint64 time() const;
-    void setTime(qint64 newTime);
+
+    /**
+     * \returns the playback time in msec, interpolated from the time VLC last
+     * reported while playing. Unlike time() this does not go into libVLC, it
+     * is lock-free and can be called from any thread.
+     */
+    qint64 clockTime() const;
+    /**
+     * \param newTime time to seek to in msec
+     * \param fast whether seeking to the nearest keyframe is good enough, only
+     *        supported by VLC 4, older versions decide by the input-fast-seek
+     *        option of the media
+     */
+    void setTime(qint64 newTime, bool fast = false);
 
     bool isSeekable() const;
 
@@ -225,6 +251,9 @@ public:
 
     bool setAudioTrack(int track);
 
+    /// Deselects the video track, closing the video output.
+    void disableVideo();
+
     void setCdTrack(int track);
 
     void setEqualizer(libvlc_equalizer_t *equalizer);
@@ -242,10 +271,40 @@ Q_SIGNALS:
     void mutedChanged(bool mute);
     void volumeChanged(float volume);
 
+private Q_SLOTS:
+    /// Emits the signals of all events coalesced since the last dispatch.
+    void dispatchEvents();
+
 private:
     static void event_cb(const libvlc_event_t *event, void *opaque);
     void setVolumeInternal();
 
+    /// Marks \p events as pending, posting a dispatch unless one already is.
+    void postEvents(int events);
+
+    /**
+     * Queues \p emitter to be invoked by the next dispatch, in the order
+     * of the calls. For all but the frequent events, see event_cb().
+     */
+    void postOrdered(const std::function<void ()> &emitter);
+
+    /**
+     * Rebases the clock on \p time, or on the current time if \p time is
+     * negative, and sets whether it runs (1), stands (0) or keeps going as
+     * it is (-1). If \p monotonic is set a running clock does not go back
+     * from what it read so far.
+     */
+    void updateClock(qint64 time, int running = -1, bool monotonic = false);
+
+    /**
+     * Starts a window in which time reports may take the clock back, to
+     * \p target or anywhere if it is negative.
+     */
+    void seekClock(qint64 target);
+
+    /// Rebases the clock on a time reported by VLC, see seekClock().
+    void reportClockTime(qint64 time);
+
     Media *m_media;
 
     libvlc_media_player_t *m_player;
@@ -253,6 +312,31 @@ private:
     bool m_doingPausedPlay;
     int m_volume;
     qreal m_fadeAmount;
+
+    /// Latest values of frequent events, written by VLC threads, see event_cb().
+    QAtomicInteger<qint64> m_latestTime;
+    QAtomicInteger<qint64> m_latestLength;
+    QAtomicInt m_latestBuffer;
+    /// Events not dispatched yet.
+    QAtomicInt m_pendingEvents;
+    /// State changes and the like must neither get lost nor reordered, so
+    /// they are queued rather than coalesced.
+    QMutex m_orderedMutex;
+    QVector<std::function<void ()> > m_orderedEvents;
+
+    /// Seqlock guarding the clock, odd while an update is in progress.
+    QAtomicInt m_clockSequence;
+    /// Serializes clock updates, readers never take it.
+    QMutex m_clockMutex;
+    QAtomicInteger<qint64> m_clockBase;
+    QAtomicInteger<qint64> m_clockStamp;
+    /// The clock never reads less, see updateClock().
+    QAtomicInteger<qint64> m_clockFloor;
+    QAtomicInt m_clockRunning;
+    QElapsedTimer m_clockTimer;
+    /// Set by seeks, guarded by m_clockMutex. The stamp is -1 if not seeking.
+    qint64 m_clockSeekTarget;
+    qint64 m_clockSeekStamp;
 };
 
 QDebug operator<<(QDebug dbg, const MediaPlayer::State &s);
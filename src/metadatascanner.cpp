@@ -0,0 +1,162 @@
+/*
+    Copyright (C) 2026 vlc-phonon AUTHORS <kde-multimedia@kde.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "metadatascanner.h"
+
+#include <QtCore/QFileInfo>
+
+#include "utils/debug.h"
+#include "utils/libvlc.h"
+#include "media.h"
+#include "mediainfocache.h"
+
+// Default number of media parsed at the same time.
+#define SCAN_CONCURRENCY 4
+// Default time in msec after which parsing a media is given up.
+#define SCAN_TIMEOUT 5000
+
+namespace Phonon {
+namespace VLC {
+
+MetaDataScanner::MetaDataScanner(QObject *parent)
+    : QObject(parent)
+    , m_cache(MediaInfoCache::instance())
+    , m_instance(LibVLC::self ? LibVLC::self->vlc() : 0)
+    , m_concurrency(SCAN_CONCURRENCY)
+    , m_timeout(SCAN_TIMEOUT)
+    , m_scanning(false)
+{
+    qRegisterMetaType<QMultiMap<QString, QString> >("QMultiMap<QString, QString>");
+    if (m_instance)
+        libvlc_retain(m_instance);
+}
+
+MetaDataScanner::~MetaDataScanner()
+{
+    qDeleteAll(m_parsing.keys());
+    if (m_instance)
+        libvlc_release(m_instance);
+}
+
+void MetaDataScanner::setConcurrency(int concurrency)
+{
+    m_concurrency = qMax(1, concurrency);
+    startParsing();
+}
+
+void MetaDataScanner::setTimeout(int msec)
+{
+    m_timeout = msec < 0 ? -1 : msec;
+}
+
+void MetaDataScanner::scan(const QList<QUrl> &urls)
+{
+    foreach (const QUrl &url, urls) {
+        if (url.isValid())
+            m_queue.enqueue(url);
+    }
+    if (m_queue.isEmpty())
+        return;
+    m_scanning = true;
+    // Also cached entries are only reported once back in the event loop, the
+    // caller may not be done connecting yet.
+    QMetaObject::invokeMethod(this, "startParsing", Qt::QueuedConnection);
+}
+
+void MetaDataScanner::cancel()
+{
+    m_queue.clear();
+    qDeleteAll(m_parsing.keys());
+    m_parsing.clear();
+    if (m_scanning) {
+        m_scanning = false;
+        emit finished();
+    }
+}
+
+void MetaDataScanner::startParsing()
+{
+    while (m_parsing.size() < m_concurrency && !m_queue.isEmpty()) {
+        const QUrl url = m_queue.dequeue();
+        QByteArray mrl;
+        if (url.scheme().isEmpty())
+            mrl = QUrl::fromLocalFile(QFileInfo(url.toString()).absoluteFilePath()).toEncoded();
+        else
+            mrl = url.toEncoded();
+
+        Job job;
+        job.url = url;
+        const bool local = mrl.startsWith("file://");
+        if (local) {
+            MediaInfo info;
+            if (m_cache && m_cache->lookup(mrl, &info)) {
+                emit scanned(url, info.metaData, info.duration,
+                             info.audioTracks, info.videoTracks, info.subtitleTracks);
+                continue;
+            }
+            job.modified = MediaInfoCache::modificationTime(mrl);
+            if (!job.modified.isValid()) {
+                emit failed(url);
+                continue;
+            }
+        }
+
+        if (!m_instance) {
+            emit failed(url);
+            continue;
+        }
+        Media *media = new Media(mrl, m_instance, this);
+        connect(media, SIGNAL(parsed(bool)), this, SLOT(onParsed(bool)));
+        if (!media->startParsing(!local, m_timeout)) {
+            warning() << "could not start parsing" << mrl;
+            delete media;
+            emit failed(url);
+            continue;
+        }
+        m_parsing.insert(media, job);
+    }
+
+    if (m_scanning && m_queue.isEmpty() && m_parsing.isEmpty()) {
+        m_scanning = false;
+        emit finished();
+    }
+}
+
+void MetaDataScanner::onParsed(bool success)
+{
+    Media *media = qobject_cast<Media *>(sender());
+    if (!media || !m_parsing.contains(media))
+        return;
+
+    const Job job = m_parsing.take(media);
+    if (success) {
+        const MediaInfo info = MediaInfo::fromMedia(media);
+        if (m_cache)
+            m_cache->insert(media->mrl(), job.modified, info);
+        emit scanned(job.url, info.metaData, info.duration,
+                     info.audioTracks, info.videoTracks, info.subtitleTracks);
+    } else {
+        debug() << "parsing failed or timed out:" << job.url;
+        emit failed(job.url);
+    }
+    media->deleteLater();
+
+    startParsing();
+}
+
+} // namespace VLC
+} // namespace Phonon
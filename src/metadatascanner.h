@@ -0,0 +1,133 @@
+/*
+    Copyright (C) 2026 vlc-phonon AUTHORS <kde-multimedia@kde.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PHONON_VLC_METADATASCANNER_H
+#define PHONON_VLC_METADATASCANNER_H
+
+#include <QtCore/QDateTime>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMultiMap>
+#include <QtCore/QObject>
+#include <QtCore/QQueue>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QUrl>
+
+struct libvlc_instance_t;
+
+namespace Phonon {
+namespace VLC {
+
+class Media;
+class MediaInfoCache;
+
+/**
+ * \brief Reads meta data, duration and track layout of many media at once,
+ * e.g. to fill a music library.
+ *
+ * Nothing gets played, the media are only parsed. A fixed number of them is
+ * handed to VLC's preparser at a time and each one is given up on after a
+ * timeout, so a broken file or an unreachable stream does not hold up the
+ * whole scan.
+ *
+ * Local files already in the MediaInfoCache are answered from it, those
+ * parsed by the scanner are added to it, so playing them later has their
+ * information right away. The scanner holds on to the cache and to libVLC,
+ * so it may outlive the Backend.
+ *
+ * Results are delivered in the thread the scanner lives in, which needs an
+ * event loop, in the order parsing finishes rather than the order of the
+ * URLs.
+ */
+class MetaDataScanner : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(int concurrency READ concurrency WRITE setConcurrency)
+    Q_PROPERTY(int timeout READ timeout WRITE setTimeout)
+public:
+    explicit MetaDataScanner(QObject *parent = nullptr);
+    ~MetaDataScanner();
+
+    /// \returns how many media get parsed at the same time
+    int concurrency() const { return m_concurrency; }
+
+    /**
+     * Sets how many media get parsed at the same time. VLC may run fewer
+     * parsers than that, the rest then wait within VLC.
+     */
+    void setConcurrency(int concurrency);
+
+    /// \returns the time in msec after which parsing a media is given up
+    int timeout() const { return m_timeout; }
+
+    /// Sets the time in msec after which parsing a media is given up, -1 for none.
+    void setTimeout(int msec);
+
+    /// Queues \p urls for scanning.
+    Q_INVOKABLE void scan(const QList<QUrl> &urls);
+
+    /// Drops all queued media and aborts the running ones.
+    Q_INVOKABLE void cancel();
+
+Q_SIGNALS:
+    /**
+     * Emitted for every media that could be parsed.
+     *
+     * \param metaData the meta data, with the keys of Phonon::MetaData
+     * \param duration the duration in msec, -1 if unknown
+     * \param audioTracks the number of audio tracks
+     * \param videoTracks the number of video tracks
+     * \param subtitleTracks the number of subtitle tracks
+     */
+    void scanned(const QUrl &url, const QMultiMap<QString, QString> &metaData, qint64 duration,
+                 int audioTracks, int videoTracks, int subtitleTracks);
+
+    /// Emitted for every media that could not be parsed or timed out.
+    void failed(const QUrl &url);
+
+    /// Emitted when the last queued media is done.
+    void finished();
+
+private Q_SLOTS:
+    void startParsing();
+    void onParsed(bool success);
+
+private:
+    struct Job
+    {
+        QUrl url;
+        /// Modification time of a local file at the start, invalid otherwise.
+        QDateTime modified;
+    };
+
+    /// Null if the Backend was already gone when the scanner was created.
+    QSharedPointer<MediaInfoCache> m_cache;
+    /// Null if the Backend was already gone when the scanner was created.
+    libvlc_instance_t *m_instance;
+    int m_concurrency;
+    int m_timeout;
+    /// Whether finished() is still due.
+    bool m_scanning;
+
+    QQueue<QUrl> m_queue;
+    QHash<Media *, Job> m_parsing;
+};
+
+} // namespace VLC
+} // namespace Phonon
+
+#endif // PHONON_VLC_METADATASCANNER_H
@@ -20,8 +20,10 @@
 
 #include "streamreader.h"
 
+#include <QtCore/QFile>
 #include <QtCore/QMutexLocker>
 
+#include <phonon/abstractmediastream.h>
 #include <phonon/streaminterface.h>
 
 #include "utils/debug.h"
@@ -33,8 +35,48 @@ namespace Phonon {
 namespace VLC {
 
 #define BLOCKSIZE 32768
+#define MIN_BLOCKSIZE 4096
+#define MAX_BLOCKSIZE (1024 * 1024)
+// The adaptive block size aims for this many reads per second, which keeps
+// the callback overhead low for high bitrates and the latency low for low ones.
+#define TARGET_READS_PER_SECOND 50
+// Minimum time between two adaptions of the block size (msec).
+#define ADAPT_INTERVAL 1000
+// Default limit of the range cache.
+#define CACHESIZE (4 * 1024 * 1024)
+// Blocks kept around for reuse, libVLC only ever holds one at a time.
+#define MAX_FREE_BLOCKS 4
+// pts, dts and flags in front of every packet, see setElementaryStreamFormat().
+#define PACKET_HEADER_SIZE (2 * sizeof(qint64) + sizeof(quint32))
+
+// imem categories (see imem-cat), data means a byte stream that gets demuxed.
+enum {
+    ImemAudio = 1,
+    ImemVideo = 2,
+    ImemSubtitle = 3,
+    ImemData = 4
+};
+
+// Optional elementary stream properties and the imem options they map to.
+static const struct {
+    const char *property;
+    const char *option;
+} elementaryStreamOptions[] = {
+    { "elementaryStreamLanguage", "imem-language" },
+    { "elementaryStreamSampleRate", "imem-samplerate" },
+    { "elementaryStreamChannels", "imem-channels" },
+    { "elementaryStreamWidth", "imem-width" },
+    { "elementaryStreamHeight", "imem-height" },
+    { "elementaryStreamAspectRatio", "imem-dar" },
+    { "elementaryStreamFrameRate", "imem-fps" }
+};
+
+static QVariant streamProperty(const QObject *stream, const char *name)
+{
+    return stream ? stream->property(name) : QVariant();
+}
 
-StreamReader::StreamReader(MediaObject *parent)
+StreamReader::StreamReader(const MediaSource &source, MediaObject *parent)
     : QObject(parent)
     , m_pos(0)
     , m_size(0)
@@ -42,7 +84,31 @@ StreamReader::StreamReader(MediaObject *parent)
     , m_seekable(false)
     , m_unlocked(false)
     , m_mediaObject(parent)
+    , m_queuedBytes(0)
+    , m_writeGeneration(0)
+    , m_seekedGeneration(new QAtomicInt(0))
+    , m_bufferLevel(0)
+    , m_readerWaiting(0)
+    , m_lentBlock(0)
+    , m_blockSize(BLOCKSIZE)
+    , m_adaptiveBlockSize(false)
+    , m_adaptBytes(0)
+    , m_adaptReads(0)
+    , m_adaptStalls(0)
+    , m_prefetchLowMark(0)
+    , m_prefetchHighMark(0)
+    , m_dataRequested(0)
+    , m_stallCount(0)
+    , m_stallTime(0)
+    , m_writePos(0)
+    , m_cacheSize(0)
+    , m_cacheLimit(CACHESIZE)
+    , m_category(0)
+    , m_packetBytes(0)
+    , m_mappedFile(0)
+    , m_mappedData(0)
 {
+    m_stream = source.stream();
 }
 
 StreamReader::~StreamReader()
@@ -53,7 +119,44 @@ void StreamReader::addToMedia(Media *media)
 {
     lock(); // Make sure we can lock in read().
 
-    media->addOption(QLatin1String("imem-cat=4"));
+    {
+        QMutexLocker lock(&m_mutex);
+        const QObject *stream = m_stream.data();
+        const int blockSize = streamProperty(stream, "streamBlockSize").toInt();
+        m_blockSize.storeRelease(blockSize > 0 ? qBound(MIN_BLOCKSIZE, blockSize, MAX_BLOCKSIZE) : BLOCKSIZE);
+        m_adaptiveBlockSize = streamProperty(stream, "streamBlockSizeAdaptive").toBool();
+        m_adaptBytes = 0;
+        m_adaptReads = 0;
+        m_adaptStalls = 0;
+        m_adaptTimer.start();
+        debug() << "block size" << m_blockSize.loadAcquire() << "adaptive" << m_adaptiveBlockSize;
+
+        m_prefetchHighMark = qMax(0, streamProperty(stream, "streamPrefetchHighMark").toInt());
+        m_prefetchLowMark = streamProperty(stream, "streamPrefetchLowMark").toInt();
+        if (m_prefetchLowMark <= 0 || m_prefetchLowMark > m_prefetchHighMark) {
+            m_prefetchLowMark = m_prefetchHighMark / 2;
+        }
+        const QVariant cacheLimit = streamProperty(stream, "streamCacheSize");
+        if (cacheLimit.isValid()) {
+            m_cacheLimit = qMax<qint64>(0, cacheLimit.toLongLong());
+        }
+
+        if (m_prefetchHighMark > 0) {
+            debug() << "prefetching between" << m_prefetchLowMark << "and" << m_prefetchHighMark;
+            m_buffer.reserve(m_prefetchHighMark);
+            // Start filling right away rather than waiting for the first read.
+            prefetch();
+        }
+    }
+
+    if (isPacketized()) {
+        media->addOption(QString("imem-cat=%1").arg(m_category));
+        foreach (const QString &option, m_streamOptions) {
+            media->addOption(option);
+        }
+    } else {
+        media->addOption(QString("imem-cat=%1").arg(ImemData));
+    }
     media->addOption(QLatin1String("imem-data="), INTPTR_PTR(this));
     media->addOption(QLatin1String("imem-get="), INTPTR_FUNC(readCallback));
     media->addOption(QLatin1String("imem-release="), INTPTR_FUNC(readDoneCallback));
@@ -61,11 +164,80 @@ void StreamReader::addToMedia(Media *media)
 
     // if stream has known size, we may pass it
     // imem module will use it and pass it to demux
-    if (streamSize() > 0) {
+    if (streamSize() > 0 && !isPacketized()) {
         media->addOption(QString("imem-size=%1").arg(streamSize()));
     }
 }
 
+bool StreamReader::mapFile(const QString &fileName)
+{
+    QFile *file = new QFile(fileName, this);
+    if (!file->open(QIODevice::ReadOnly) || file->size() <= 0) {
+        delete file;
+        return false;
+    }
+
+    const uchar *data = file->map(0, file->size());
+    if (!data) {
+        debug() << "Failed to map" << fileName << file->errorString();
+        delete file;
+        return false;
+    }
+
+    debug() << "Serving" << fileName << "from memory mapping";
+    {
+        QMutexLocker lock(&m_mutex);
+        m_mappedFile = file;
+        m_mappedData = reinterpret_cast<const char *>(data);
+        m_cacheLimit = 0; // Everything is cached already.
+    }
+    setStreamSize(file->size());
+    setStreamSeekable(true);
+    return true;
+}
+
+bool StreamReader::setElementaryStreamFormat(const QObject *stream)
+{
+    if (!stream) {
+        return false;
+    }
+
+    const QString category = stream->property("elementaryStreamCategory").toString();
+    const QString codec = stream->property("elementaryStreamCodec").toString();
+    if (category.isEmpty()) {
+        return false;
+    }
+
+    int imemCategory = 0;
+    if (category == QLatin1String("audio")) {
+        imemCategory = ImemAudio;
+    } else if (category == QLatin1String("video")) {
+        imemCategory = ImemVideo;
+    } else if (category == QLatin1String("subtitle")) {
+        imemCategory = ImemSubtitle;
+    }
+    if (!imemCategory || codec.isEmpty()) {
+        warning() << "Ignoring incomplete elementary stream format" << category << codec;
+        return false;
+    }
+
+    QStringList options;
+    options << QString("imem-codec=%1").arg(codec);
+    for (size_t i = 0; i < sizeof(elementaryStreamOptions) / sizeof(elementaryStreamOptions[0]); ++i) {
+        const QVariant value = stream->property(elementaryStreamOptions[i].property);
+        if (value.isValid()) {
+            options << QString("%1=%2").arg(QLatin1String(elementaryStreamOptions[i].option), value.toString());
+        }
+    }
+    debug() << "Elementary stream packets" << category << options;
+
+    QMutexLocker lock(&m_mutex);
+    m_category = imemCategory;
+    m_streamOptions = options;
+    m_cacheLimit = 0; // Packets are consumed once, there is nothing to seek into.
+    return true;
+}
+
 void StreamReader::lock()
 {
     QMutexLocker lock(&m_mutex);
@@ -75,10 +247,12 @@ void StreamReader::lock()
 
 void StreamReader::unlock()
 {
-    QMutexLocker lock(&m_mutex);
-    DEBUG_BLOCK;
-    m_unlocked = true;
-    m_waitingForData.wakeAll();
+    {
+        QMutexLocker lock(&m_mutex);
+        DEBUG_BLOCK;
+        m_unlocked = true;
+    }
+    wakeUpReader();
 }
 
 int StreamReader::readCallback(void *data, const char *cookie,
@@ -86,18 +260,29 @@ int StreamReader::readCallback(void *data, const char *cookie,
                                size_t *bufferSize, void **buffer)
 {
     Q_UNUSED(cookie);
-    Q_UNUSED(dts);
-    Q_UNUSED(pts);
-    Q_UNUSED(flags);
 
     StreamReader *that = static_cast<StreamReader *>(data);
-    size_t length = BLOCKSIZE;
 
-    *buffer = new char[length];
+    if (that->isPacketized()) {
+        qint64 packetPts = -1;
+        qint64 packetDts = -1;
+        int size = 0;
+        char *payload = 0;
+        bool ret = that->readPacket(&packetPts, &packetDts, flags, &size, &payload);
+
+        *pts = packetPts;
+        *dts = packetDts;
+        *buffer = payload;
+        *bufferSize = static_cast<size_t>(size);
 
-    int size = length;
-    bool ret = that->read(that->currentPos(), &size, static_cast<char*>(*buffer));
+        return ret ? 0 : -1;
+    }
+
+    int size = that->blockSize();
+    char *block = 0;
+    bool ret = that->readBlock(that->currentPos(), &size, &block);
 
+    *buffer = block;
     *bufferSize = static_cast<size_t>(size);
 
     return ret ? 0 : -1;
@@ -106,10 +291,10 @@ int StreamReader::readCallback(void *data, const char *cookie,
 int StreamReader::readDoneCallback(void *data, const char *cookie,
                                    size_t bufferSize, void *buffer)
 {
-    Q_UNUSED(data);
     Q_UNUSED(cookie);
     Q_UNUSED(bufferSize);
-    delete[] static_cast<char *>(buffer);
+    StreamReader *that = static_cast<StreamReader *>(data);
+    that->releaseBlock(static_cast<char *>(buffer));
     return 0;
 }
 
@@ -129,73 +314,505 @@ int StreamReader::seekCallback(void *data, const uint64_t pos)
 
 quint64 StreamReader::currentBufferSize() const
 {
-    return m_buffer.size();
+    return m_buffer.size() + m_packetBytes;
 }
 
 bool StreamReader::read(quint64 pos, int *length, char *buffer)
 {
     QMutexLocker lock(&m_mutex);
-    DEBUG_BLOCK;
-    bool ret = true;
 
     if (m_unlocked) {
-        return ret;
+        return true;
+    }
+
+    if (m_mappedData) {
+        *length = static_cast<int>(qBound<qint64>(0, static_cast<qint64>(m_size - qMin(pos, m_size)), *length));
+        memcpy(buffer, m_mappedData + pos, *length);
+        m_pos = pos + *length;
+        return *length > 0;
+    }
+
+    if (!waitForData(pos, length)) {
+        return false;
+    }
+
+    // Only the returned bytes are copied, the remainder stays where it is.
+    *length = m_buffer.read(buffer, *length);
+    m_pos += *length;
+    prefetch();
+
+    return true;
+}
+
+bool StreamReader::readBlock(quint64 pos, int *length, char **block)
+{
+    QMutexLocker lock(&m_mutex);
+
+    if (m_unlocked) {
+        *block = acquireBlock(*length);
+        return true;
+    }
+
+    if (m_mappedData) {
+        // The mapping outlives any block libVLC may hold, nothing to manage.
+        *length = static_cast<int>(qBound<qint64>(0, static_cast<qint64>(m_size - qMin(pos, m_size)), *length));
+        *block = const_cast<char *>(m_mappedData + pos);
+        m_pos = pos + *length;
+        return *length > 0;
+    }
+
+    if (!waitForData(pos, length)) {
+        *block = 0;
+        return false;
+    }
+
+    int contiguous = 0;
+    m_buffer.readPointer(&contiguous);
+    if (contiguous >= *length && !m_lentBlock) {
+        // No need to copy anything, libVLC reads straight out of our buffer.
+        // The region stays pinned until readDoneCallback.
+        m_lentBlock = m_buffer.lend(*length);
+        *block = const_cast<char *>(m_lentBlock);
+    } else {
+        *block = acquireBlock(*length);
+        *length = m_buffer.read(*block, *length);
+    }
+    m_pos += *length;
+    prefetch();
+
+    if (m_adaptiveBlockSize) {
+        m_adaptBytes += *length;
+        ++m_adaptReads;
+        adaptBlockSize();
+    }
+
+    return true;
+}
+
+bool StreamReader::readPacket(qint64 *pts, qint64 *dts, unsigned *flags, int *length, char **payload)
+{
+    QMutexLocker lock(&m_mutex);
+
+    QElapsedTimer stallTimer;
+    for (;;) {
+        // See waitForData() for why the end is checked before draining.
+        const bool eos = m_eos;
+        drainQueue();
+        if (!m_packets.isEmpty()) {
+            break;
+        }
+        if (m_unlocked) {
+            *length = 0;
+            *payload = 0;
+            return true;
+        }
+        if (eos) {
+            return false;
+        }
+        if (!stallTimer.isValid()) {
+            ++m_stallCount;
+            stallTimer.start();
+        }
+        requestData();
+        waitForWrite();
+    }
+    if (stallTimer.isValid()) {
+        m_stallTime += stallTimer.elapsed();
+        publishStalls();
+    }
+
+    // libVLC releases a packet before getting the next one, keeping it alive
+    // here is all it takes to lend the payload without copying.
+    m_lentPacket = m_packets.takeFirst();
+    m_packetBytes -= m_lentPacket.size();
+    m_pos += m_lentPacket.size();
+
+    const char *header = m_lentPacket.constData();
+    quint32 packetFlags = 0;
+    memcpy(pts, header, sizeof(qint64));
+    memcpy(dts, header + sizeof(qint64), sizeof(qint64));
+    memcpy(&packetFlags, header + 2 * sizeof(qint64), sizeof(quint32));
+    *flags = packetFlags;
+    *length = m_lentPacket.size() - static_cast<int>(PACKET_HEADER_SIZE);
+    *payload = const_cast<char *>(header + PACKET_HEADER_SIZE);
+
+    prefetch();
+    return true;
+}
+
+void StreamReader::releaseBlock(char *block)
+{
+    QMutexLocker lock(&m_mutex);
+    if (!block) {
+        return;
+    }
+    if (!m_lentPacket.isNull() && block == m_lentPacket.constData() + PACKET_HEADER_SIZE) {
+        m_lentPacket = QByteArray();
+        return;
+    }
+    if (m_mappedData && block >= m_mappedData && block <= m_mappedData + m_size) {
+        return;
     }
+    if (block && block == m_lentBlock) {
+        m_buffer.release();
+        m_lentBlock = 0;
+        return;
+    }
+    recycleBlock(block);
+}
+
+bool StreamReader::waitForData(quint64 pos, int *length)
+{
+    // Account for everything written so far before the position may change.
+    drainQueue();
 
     if (currentPos() != pos) {
         if (!streamSeekable()) {
             return false;
         }
-        setCurrentPos(pos);
+        seekInternal(pos);
     }
 
     if (m_buffer.capacity() < *length) {
         m_buffer.reserve(*length);
     }
 
+    if (currentBufferSize() < static_cast<unsigned int>(*length)) {
+        fillFromCache(*length - m_buffer.size());
+    }
+
+    QElapsedTimer stallTimer;
+    if (currentBufferSize() < static_cast<unsigned int>(*length)) {
+        ++m_adaptStalls;
+        ++m_stallCount;
+        stallTimer.start();
+    }
+
     while (currentBufferSize() < static_cast<unsigned int>(*length)) {
         quint64 oldSize = currentBufferSize();
-        needData();
+        requestData();
 
-        m_waitingForData.wait(&m_mutex);
+        waitForWrite();
+        // The application signals the end only after its last write, so
+        // checking before draining never misses data.
+        const bool eos = m_eos;
+        drainQueue();
 
         if (oldSize == currentBufferSize()) {
-            if (m_eos && m_buffer.isEmpty()) {
+            if (!eos && !m_unlocked) {
+                // Woken up by data that did not continue our buffer, ask again.
+                continue;
+            }
+            if (eos && m_buffer.isEmpty()) {
                 return false;
             }
             // We didn't get any more data
             *length = static_cast<int>(oldSize);
             // If we have some data to return, why tell to reader that we failed?
             // Remember that length argument is more like maxSize not requiredSize
-            ret = true;
         }
     }
 
-    if (m_mediaObject->state() != Phonon::BufferingState &&
+    if (stallTimer.isValid()) {
+        m_stallTime += stallTimer.elapsed();
+        publishStalls();
+    }
+
+    // With prefetching enabled writeData() decides when we have enough.
+    if (m_prefetchHighMark <= 0 &&
+        m_mediaObject->state() != Phonon::BufferingState &&
         m_mediaObject->state() != Phonon::LoadingState) {
+        m_dataRequested.storeRelease(0);
         enoughData();
     }
 
-    memcpy(buffer, m_buffer.data(), *length);
-    m_pos += *length;
-    // trim the buffer by the amount read
-    m_buffer = m_buffer.mid(*length);
+    return true;
+}
+
+void StreamReader::waitForWrite()
+{
+    // Announce that we are about to sleep, then check once more. Whoever
+    // takes the flag back owes the semaphore exactly one release.
+    m_readerWaiting.fetchAndStoreOrdered(1);
+    if (!m_queue.isEmpty() || m_eos || m_unlocked) {
+        if (!m_readerWaiting.fetchAndStoreOrdered(0)) {
+            // A writer beat us to it, consume its wake up.
+            m_wakeUp.acquire();
+        }
+        return;
+    }
+
+    m_mutex.unlock();
+    m_wakeUp.acquire();
+    m_mutex.lock();
+}
+
+void StreamReader::wakeUpReader()
+{
+    if (m_readerWaiting.fetchAndStoreOrdered(0)) {
+        m_wakeUp.release();
+    }
+}
+
+void StreamReader::drainQueue()
+{
+    QueuedChunk chunk;
+    while (m_queue.dequeue(&chunk)) {
+        const QByteArray data = chunk.data;
+        m_queuedBytes.fetchAndAddOrdered(-data.size());
+
+        if (chunk.generation != m_writeGeneration.loadRelaxed()) {
+            // Written at a position we asked the application to leave, we
+            // cannot tell where it belongs.
+            debug() << "Dropping" << data.size() << "bytes written before a seek";
+            continue;
+        }
+
+        if (isPacketized()) {
+            if (data.size() < static_cast<int>(PACKET_HEADER_SIZE)) {
+                warning() << "Dropping packet of" << data.size() << "bytes, too short for its header";
+                continue;
+            }
+            m_packets.append(data);
+            m_packetBytes += data.size();
+            m_writePos += data.size();
+            continue;
+        }
+
+        cacheData(m_writePos, data);
+
+        // Data only goes into the buffer if it continues where the buffer ends.
+        // It may not, e.g. while the application still writes behind a range we
+        // served from the cache.
+        const quint64 bufferEnd = m_pos + m_buffer.size();
+        if (m_writePos <= bufferEnd && bufferEnd < m_writePos + data.size()) {
+            const int skip = static_cast<int>(bufferEnd - m_writePos);
+            m_buffer.append(data.constData() + skip, data.size() - skip);
+        }
+        m_writePos += data.size();
+    }
+    m_bufferLevel.storeRelease(static_cast<int>(currentBufferSize()));
+}
+
+char *StreamReader::acquireBlock(int size)
+{
+    QByteArray block;
+    for (int i = 0; i < m_freeBlocks.size(); ++i) {
+        if (m_freeBlocks.at(i).size() >= size) {
+            block = m_freeBlocks.takeAt(i);
+            break;
+        }
+    }
+    if (block.isNull()) {
+        block = QByteArray(size, Qt::Uninitialized);
+    }
+    // Get the pointer while we hold the only reference, so nothing detaches.
+    char *data = block.data();
+    m_usedBlocks.append(block);
+    return data;
+}
+
+void StreamReader::recycleBlock(char *block)
+{
+    for (int i = 0; i < m_usedBlocks.size(); ++i) {
+        if (m_usedBlocks.at(i).constData() == block) {
+            const QByteArray used = m_usedBlocks.takeAt(i);
+            if (m_freeBlocks.size() < MAX_FREE_BLOCKS) {
+                m_freeBlocks.append(used);
+            }
+            return;
+        }
+    }
+    warning() << "Attempted to release unknown block" << static_cast<void *>(block);
+}
+
+int StreamReader::blockSize() const
+{
+    // Atomic rather than under the mutex, readBlock() takes that right after.
+    return m_blockSize.loadAcquire();
+}
+
+void StreamReader::publishStalls()
+{
+    if (!m_stream) {
+        return;
+    }
+    // Properties are only safe to set in the stream's thread.
+    QObject *stream = m_stream.data();
+    const int count = m_stallCount;
+    const qint64 time = m_stallTime;
+    QMetaObject::invokeMethod(stream, [stream, count, time]() {
+        stream->setProperty("streamStallCount", count);
+        stream->setProperty("streamStallTime", time);
+    }, Qt::QueuedConnection);
+}
 
-    return ret;
+void StreamReader::prefetch()
+{
+    drainQueue();
+    if (m_prefetchHighMark <= 0 || m_dataRequested.loadAcquire() || m_eos) {
+        return;
+    }
+    if (currentBufferSize() < static_cast<quint64>(m_prefetchLowMark)) {
+        fillFromCache(m_prefetchHighMark - m_buffer.size());
+        m_bufferLevel.storeRelease(static_cast<int>(currentBufferSize()));
+    }
+    if (currentBufferSize() < static_cast<quint64>(m_prefetchLowMark)) {
+        requestData();
+    }
+}
+
+void StreamReader::requestData()
+{
+    const quint64 bufferEnd = m_pos + m_buffer.size();
+    if (m_writePos != bufferEnd && streamSeekable()) {
+        // The application is positioned elsewhere, e.g. because the last seek
+        // was served from the cache.
+        seekWriter(bufferEnd);
+    }
+    m_dataRequested.storeRelease(1);
+    needData();
+}
+
+void StreamReader::cacheData(quint64 offset, const QByteArray &data)
+{
+    if (m_cacheLimit <= 0 || data.isEmpty()) {
+        return;
+    }
+
+    // Chunks are implicitly shared with the caller, so unless they overlap
+    // with what we already have caching them costs no copy.
+    QByteArray chunk = data;
+    const quint64 end = offset + chunk.size();
+
+    QMap<quint64, QByteArray>::iterator it = m_cache.upperBound(offset);
+    if (it != m_cache.begin()) {
+        QMap<quint64, QByteArray>::iterator previous = it;
+        --previous;
+        const quint64 previousEnd = previous.key() + previous.value().size();
+        if (previousEnd >= end) {
+            return; // Already cached entirely.
+        }
+        if (previousEnd > offset) {
+            chunk = chunk.mid(previousEnd - offset);
+            offset = previousEnd;
+        }
+    }
+    while (it != m_cache.end() && it.key() < end) {
+        if (it.key() + it.value().size() <= end) {
+            m_cacheSize -= it.value().size();
+            it = m_cache.erase(it);
+        } else {
+            chunk.truncate(it.key() - offset);
+            break;
+        }
+    }
+    m_cache.insert(offset, chunk);
+    m_cacheSize += chunk.size();
+
+    // Evict whatever is farthest away from the read position.
+    while (m_cacheSize > m_cacheLimit && !m_cache.isEmpty()) {
+        QMap<quint64, QByteArray>::iterator first = m_cache.begin();
+        QMap<quint64, QByteArray>::iterator last = m_cache.end();
+        --last;
+        const quint64 firstDistance = m_pos > first.key() ? m_pos - first.key() : 0;
+        const quint64 lastDistance = last.key() > m_pos ? last.key() - m_pos : 0;
+        QMap<quint64, QByteArray>::iterator victim = firstDistance >= lastDistance ? first : last;
+        m_cacheSize -= victim.value().size();
+        m_cache.erase(victim);
+    }
+}
+
+bool StreamReader::isCached(quint64 offset) const
+{
+    QMap<quint64, QByteArray>::const_iterator it = m_cache.upperBound(offset);
+    if (it == m_cache.constBegin()) {
+        return false;
+    }
+    --it;
+    return offset < it.key() + it.value().size();
+}
+
+int StreamReader::fillFromCache(int length)
+{
+    int filled = 0;
+    quint64 bufferEnd = m_pos + m_buffer.size();
+    while (filled < length && isCached(bufferEnd)) {
+        QMap<quint64, QByteArray>::const_iterator it = m_cache.upperBound(bufferEnd);
+        --it;
+        const int offset = static_cast<int>(bufferEnd - it.key());
+        const int count = qMin(length - filled, it.value().size() - offset);
+        m_buffer.append(it.value().constData() + offset, count);
+        filled += count;
+        bufferEnd += count;
+    }
+    return filled;
+}
+
+void StreamReader::adaptBlockSize()
+{
+    const qint64 elapsed = m_adaptTimer.elapsed();
+    if (elapsed < ADAPT_INTERVAL) {
+        return;
+    }
+
+    const qint64 bytesPerSecond = m_adaptBytes * 1000 / elapsed;
+    int blockSize = MIN_BLOCKSIZE;
+    while (blockSize < MAX_BLOCKSIZE && blockSize * TARGET_READS_PER_SECOND < bytesPerSecond) {
+        blockSize *= 2;
+    }
+
+    // When more than a quarter of the reads had to wait for the application
+    // we are asking for more than it can deliver in time. Smaller blocks get
+    // data to the demuxer sooner.
+    const int currentBlockSize = m_blockSize.loadAcquire();
+    if (m_adaptStalls * 4 > m_adaptReads) {
+        blockSize = qMax(MIN_BLOCKSIZE, qMin(blockSize, currentBlockSize / 2));
+    }
+
+    if (blockSize != currentBlockSize) {
+        debug() << "adapting block size from" << currentBlockSize << "to" << blockSize
+                << "at" << bytesPerSecond << "B/s with" << m_adaptStalls
+                << "stalls in" << m_adaptReads << "reads";
+        m_blockSize.storeRelease(blockSize);
+    }
+
+    m_adaptBytes = 0;
+    m_adaptReads = 0;
+    m_adaptStalls = 0;
+    m_adaptTimer.restart();
 }
 
 void StreamReader::endOfData()
 {
-    m_eos = true;
-    m_waitingForData.wakeAll();
+    {
+        QMutexLocker lock(&m_mutex);
+        m_eos = true;
+    }
+    wakeUpReader();
 }
 
 void StreamReader::writeData(const QByteArray &data)
 {
-    QMutexLocker lock(&m_mutex);
-    DEBUG_BLOCK;
-    m_buffer.append(data);
-    m_waitingForData.wakeAll();
+    // Lock-free, the reader takes the chunk in on its next read (drainQueue).
+    // Queueing only shares the QByteArray, nothing is copied here.
+    QueuedChunk chunk;
+    chunk.data = data;
+    chunk.generation = m_seekedGeneration->loadAcquire();
+    m_queue.enqueue(chunk);
+    const int queued = m_queuedBytes.fetchAndAddOrdered(data.size()) + data.size();
+    wakeUpReader();
+
+    if (m_prefetchHighMark > 0 && m_dataRequested.loadAcquire()) {
+        if (m_bufferLevel.loadAcquire() + queued >= m_prefetchHighMark) {
+            if (m_dataRequested.testAndSetOrdered(1, 0)) {
+                enoughData();
+            }
+        } else {
+            // Streams that only write once per request need to be asked again.
+            needData();
+        }
+    }
 }
 
 quint64 StreamReader::currentPos() const
@@ -206,13 +823,54 @@ quint64 StreamReader::currentPos() const
 void StreamReader::setCurrentPos(qint64 pos)
 {
     QMutexLocker lock(&m_mutex);
+    drainQueue();
+    seekInternal(pos);
+}
+
+void StreamReader::seekInternal(quint64 pos)
+{
+    if (m_mappedData) {
+        m_pos = pos;
+        return;
+    }
+
     m_pos = pos;
-    m_buffer.clear(); // Not optimal, but meh
+    m_buffer.clear();
+    m_packets.clear();
+    m_packetBytes = 0;
+    m_bufferLevel.storeRelease(0);
+    m_dataRequested.storeRelease(0);
 
     // Do not touch m_size here, it reflects the size of the stream not the size of the buffer,
     // and generally seeking does not change the size!
 
+    // Cached data is served without bothering the application, it only needs
+    // to seek once we run out of cache (see requestData).
+    if (!isCached(pos)) {
+        seekWriter(pos);
+    }
+}
+
+void StreamReader::seekWriter(quint64 pos)
+{
+    // Everything queued so far was written at the old position. Taking it in
+    // now caches it where it belongs rather than at the new position.
+    drainQueue();
+    // The application seeks asynchronously in its own thread. Only what it
+    // writes once it got there is taken in, until then chunks keep the old
+    // generation and get dropped rather than taken for data at pos.
+    const int generation = m_writeGeneration.fetchAndAddOrdered(1) + 1;
     seekStream(pos);
+    QSharedPointer<QAtomicInt> seekedGeneration = m_seekedGeneration;
+    if (m_stream) {
+        QMetaObject::invokeMethod(m_stream, [seekedGeneration, generation]() {
+            seekedGeneration->storeRelease(generation);
+        }, Qt::QueuedConnection);
+    } else {
+        seekedGeneration->storeRelease(generation);
+    }
+    m_writePos = pos;
+    m_eos = false;
 }
 
 void StreamReader::setStreamSize(qint64 newSize)
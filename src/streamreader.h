@@ -26,8 +26,20 @@
 
 #include <stdint.h>
 
+#include <QtCore/QAtomicInt>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QList>
+#include <QtCore/QMap>
 #include <QtCore/QMutex>
-#include <QtCore/QWaitCondition>
+#include <QtCore/QPointer>
+#include <QtCore/QSemaphore>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QStringList>
+
+#include "utils/ringbuffer.h"
+#include "utils/spscqueue.h"
+
+class QFile;
 
 #ifndef QT_NO_PHONON_ABSTRACTMEDIASTREAM
 
@@ -53,20 +65,71 @@ class MediaObject;
  * documentation for details.
  *
  * There are callbacks implemented in streamhooks.cpp, for libVLC.
+ * Tuning and statistics go through dynamic properties of the stream, see
+ * addToMedia().
  */
 class StreamReader : public QObject, public Phonon::StreamInterface
 {
     Q_OBJECT
     Q_INTERFACES(Phonon::StreamInterface)
 public:
-    explicit StreamReader(MediaObject *parent);
+    StreamReader(const MediaSource &source, MediaObject *parent);
     ~StreamReader();
 
+    /**
+     * Reads the tuning properties of the stream, all optional:
+     * \li \c streamBlockSize (int) bytes per block handed to libVLC
+     * \li \c streamBlockSizeAdaptive (bool) adapt the block size to the bitrate
+     * \li \c streamPrefetchHighMark, \c streamPrefetchLowMark (int) read-ahead
+     * \li \c streamCacheSize (int) bytes kept across seeks, 0 disables
+     *
+     * \c streamStallCount (int) and \c streamStallTime (qint64, msec) are set
+     * on the stream whenever a read had to wait for it.
+     */
     void addToMedia(Media *media);
 
+    /**
+     * Serves the stream straight out of a read-only memory mapping of
+     * \p fileName rather than through writeData(). Blocks handed to libVLC
+     * point into the mapping and seeking is free.
+     * Must be called before the reader is connected to a source, if it fails
+     * the reader should be connected as usual.
+     *
+     * \returns \c true if the file could be mapped
+     */
+    bool mapFile(const QString &fileName);
+
+    /**
+     * Switches the reader to packet mode if \p stream describes an elementary
+     * stream through the following dynamic properties:
+     * \li \c elementaryStreamCategory (QString) "audio", "video" or "subtitle"
+     * \li \c elementaryStreamCodec (QString) VLC fourcc of the codec, e.g. "h264"
+     * \li \c elementaryStreamLanguage, \c elementaryStreamSampleRate,
+     *     \c elementaryStreamChannels, \c elementaryStreamWidth,
+     *     \c elementaryStreamHeight, \c elementaryStreamAspectRatio and
+     *     \c elementaryStreamFrameRate are optional and passed on as the
+     *     respective imem options.
+     *
+     * In packet mode every writeData() call must carry exactly one packet,
+     * prefixed by a 20 byte header in native byte order:
+     * \li qint64 presentation timestamp in microseconds, negative if unknown
+     * \li qint64 decoding timestamp in microseconds, negative if unknown
+     * \li quint32 block flags handed to libVLC as-is
+     *
+     * Must be called before addToMedia().
+     * \returns \c true if the reader is in packet mode
+     */
+    bool setElementaryStreamFormat(const QObject *stream);
+
+    /// \returns whether the reader hands out packets rather than a byte stream
+    bool isPacketized() const { return m_category != 0; }
+
     void lock();
     void unlock();
 
+    /// \returns the amount of bytes libVLC gets asked to read per block
+    int blockSize() const;
+
     static int readCallback(void *data, const char *cookie,
                             int64_t *dts, int64_t *pts, unsigned *flags, // krazy:exclude=typedefs
                             size_t *bufferSize, void **buffer);
@@ -92,6 +155,34 @@ public:
      */
     bool read(quint64 offset, int *length, char *buffer);
 
+    /**
+     * Like read() but without requiring the caller to provide memory. When the
+     * requested data is contiguous in the buffer a pointer straight into it is
+     * returned, otherwise the data is copied into a pooled block.
+     * Either way the block must be handed back through releaseBlock().
+     *
+     * \param pos Position in the stream
+     * \param length Length of the data requested, set to the length returned
+     * \param block Set to the block holding the data
+     */
+    bool readBlock(quint64 pos, int *length, char **block);
+
+    /**
+     * Packet mode counterpart of readBlock(), waits for the next packet.
+     * The payload must be handed back through releaseBlock().
+     *
+     * \param pts Set to the packet's presentation timestamp
+     * \param dts Set to the packet's decoding timestamp
+     * \param flags Set to the packet's block flags
+     * \param length Set to the length of the payload
+     * \param payload Set to the payload
+     * \returns \c false once the stream ended
+     */
+    bool readPacket(qint64 *pts, qint64 *dts, unsigned *flags, int *length, char **payload);
+
+    /// Returns a block obtained from readBlock() or readPacket().
+    void releaseBlock(char *block);
+
     void endOfData() override;
     void setStreamSize(qint64 newSize) override;
     qint64 streamSize() const;
@@ -102,15 +193,159 @@ Q_SIGNALS:
     void streamSeekableChanged(bool seekable);
 
 protected:
-    QByteArray m_buffer;
+    /**
+     * Blocks until \p length bytes are buffered or the stream ended, in the
+     * latter case \p length gets reduced to the available amount.
+     * Must be called with m_mutex locked.
+     *
+     * \returns \c false if no data can be provided for \p pos
+     */
+    bool waitForData(quint64 pos, int *length);
+
+    char *acquireBlock(int size);
+    void recycleBlock(char *block);
+
+    /**
+     * Waits until the application wrote something, the stream ended or the
+     * reader got unlocked. The mutex is released while sleeping.
+     * Must be called with m_mutex locked.
+     */
+    void waitForWrite();
+
+    /// Wakes up waitForWrite(), may be called from any thread.
+    void wakeUpReader();
+
+    /**
+     * Moves everything the application wrote since the last call from the
+     * queue into the buffer and the range cache.
+     * Must be called with m_mutex locked.
+     */
+    void drainQueue();
+
+    /**
+     * Recalculates the block size from the statistics gathered since the
+     * last adaption. Must be called with m_mutex locked.
+     */
+    void adaptBlockSize();
+
+    /**
+     * Requests more data from the application if prefetching is enabled and
+     * the buffer level dropped below the low mark.
+     * Must be called with m_mutex locked.
+     */
+    void prefetch();
+
+    /**
+     * Moves the read position without locking.
+     * \see setCurrentPos
+     */
+    void seekInternal(quint64 pos);
+
+    /**
+     * Asks the application to continue writing at \p pos.
+     * Must be called with m_mutex locked.
+     */
+    void seekWriter(quint64 pos);
+
+    /**
+     * Emits needData(), first asking the application to seek if the data it
+     * writes next would not continue where the buffer ends.
+     * Must be called with m_mutex locked.
+     */
+    void requestData();
+
+    /// Sets the stall statistics on the stream. Must be called with m_mutex locked.
+    void publishStalls();
+
+    /// Adds data written at \p offset to the range cache.
+    void cacheData(quint64 offset, const QByteArray &data);
+
+    /// \returns whether the byte at \p offset is in the range cache
+    bool isCached(quint64 offset) const;
+
+    /**
+     * Appends up to \p length bytes from the range cache to the buffer,
+     * continuing where the buffer ends.
+     * \returns number of bytes appended
+     */
+    int fillFromCache(int length);
+
+    RingBuffer m_buffer;
     quint64 m_pos;
     quint64 m_size;
     bool m_eos;
     bool m_seekable;
     bool m_unlocked;
-    QMutex m_mutex;
-    QWaitCondition m_waitingForData;
+    /// Guards everything but the members shared with writeData() below.
+    mutable QMutex m_mutex;
     MediaObject *m_mediaObject;
+
+    /// A chunk written by the application along with the m_writeGeneration it saw.
+    struct QueuedChunk
+    {
+        QueuedChunk() : generation(0) {}
+        QByteArray data;
+        int generation;
+    };
+
+    /// Chunks written by the application but not yet taken in by the reader.
+    SpscQueue<QueuedChunk> m_queue;
+    QAtomicInt m_queuedBytes;
+    /// Bumped by seekWriter(), chunks of an older generation get dropped.
+    QAtomicInt m_writeGeneration;
+    /// The last generation whose seek the application processed, chunks get
+    /// stamped with it. Shared with the acknowledgement queued to m_stream.
+    QSharedPointer<QAtomicInt> m_seekedGeneration;
+    /// The application's stream, seekStream() is handled in its thread.
+    QPointer<QObject> m_stream;
+    /// m_buffer.size() as last seen by the reader, for the prefetch check in writeData().
+    QAtomicInt m_bufferLevel;
+    /// Set by the reader before it goes to sleep on m_wakeUp.
+    QAtomicInt m_readerWaiting;
+    QSemaphore m_wakeUp;
+
+    /// Block currently lent to libVLC directly out of m_buffer.
+    const char *m_lentBlock;
+    /// Pooled blocks recycled between readCallback and readDoneCallback.
+    QList<QByteArray> m_freeBlocks;
+    QList<QByteArray> m_usedBlocks;
+
+    /// Read by readCallback() without the mutex, written with it held.
+    QAtomicInt m_blockSize;
+    bool m_adaptiveBlockSize;
+    /// Statistics for adaptBlockSize().
+    QElapsedTimer m_adaptTimer;
+    qint64 m_adaptBytes;
+    int m_adaptReads;
+    int m_adaptStalls;
+
+    int m_prefetchLowMark;
+    int m_prefetchHighMark;
+    /// Whether needData() was emitted without enoughData() following yet.
+    QAtomicInt m_dataRequested;
+    int m_stallCount;
+    qint64 m_stallTime;
+
+    /// Stream offset the application writes to next.
+    quint64 m_writePos;
+    /// Range cache of received data, keyed by stream offset.
+    QMap<quint64, QByteArray> m_cache;
+    qint64 m_cacheSize;
+    qint64 m_cacheLimit;
+
+    /// imem category, 0 unless in packet mode (see setElementaryStreamFormat()).
+    int m_category;
+    /// Options describing the elementary stream, e.g. "imem-codec=h264".
+    QStringList m_streamOptions;
+    /// Packets taken in from the queue but not yet read.
+    QList<QByteArray> m_packets;
+    int m_packetBytes;
+    /// Packet currently held by libVLC.
+    QByteArray m_lentPacket;
+
+    /// Set when serving from a file mapping, see mapFile().
+    QFile *m_mappedFile;
+    const char *m_mappedData;
 };
 
 }
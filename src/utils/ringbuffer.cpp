@@ -0,0 +1,135 @@
+/*
+    Copyright (C) 2026 vlc-phonon AUTHORS <kde-multimedia@kde.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ringbuffer.h"
+
+#include <string.h>
+
+namespace Phonon {
+namespace VLC {
+
+RingBuffer::RingBuffer(int capacity)
+    : m_data(capacity, Qt::Uninitialized)
+    , m_head(0)
+    , m_size(0)
+    , m_pinned(0)
+{
+}
+
+void RingBuffer::clear()
+{
+    if (!m_pinned)
+        m_head = 0;
+    m_size = 0;
+}
+
+void RingBuffer::reserve(int capacity)
+{
+    if (capacity <= m_data.size())
+        return;
+
+    // Linearize into the new storage so the content starts at 0 again.
+    QByteArray data(capacity, Qt::Uninitialized);
+    const int firstLength = qMin(m_size, m_data.size() - m_head);
+    memcpy(data.data(), m_data.constData() + m_head, firstLength);
+    memcpy(data.data() + firstLength, m_data.constData(), m_size - firstLength);
+
+    m_data.swap(data);
+    m_head = 0;
+
+    if (m_pinned) {
+        // The lent region lives in the old storage, keep it around until it
+        // gets released.
+        m_retired.swap(data);
+        m_pinned = 0;
+    }
+}
+
+void RingBuffer::append(const char *data, int length)
+{
+    if (length <= 0)
+        return;
+
+    if (m_pinned + m_size + length > m_data.size())
+        reserve(qMax(m_size + length, m_data.size() * 2));
+
+    const int capacity = m_data.size();
+    const int tail = (m_head + m_size) % capacity;
+    const int firstLength = qMin(length, capacity - tail);
+    memcpy(m_data.data() + tail, data, firstLength);
+    memcpy(m_data.data(), data + firstLength, length - firstLength);
+    m_size += length;
+}
+
+int RingBuffer::read(char *data, int maxLength)
+{
+    const int length = qMin(maxLength, m_size);
+    if (length <= 0)
+        return 0;
+
+    const int firstLength = qMin(length, m_data.size() - m_head);
+    memcpy(data, m_data.constData() + m_head, firstLength);
+    memcpy(data + firstLength, m_data.constData(), length - firstLength);
+    skip(length);
+    return length;
+}
+
+const char *RingBuffer::readPointer(int *length) const
+{
+    *length = qMin(m_size, m_data.size() - m_head);
+    return m_data.constData() + m_head;
+}
+
+void RingBuffer::skip(int length)
+{
+    length = qMin(length, m_size);
+    m_size -= length;
+    // While a region is lent everything consumed after it stays pinned as
+    // well, the pinned bytes always directly precede m_head.
+    if (m_pinned)
+        m_pinned += length;
+    if (m_size == 0 && !m_pinned)
+        m_head = 0; // Keep writes contiguous for as long as possible.
+    else
+        m_head = (m_head + length) % m_data.size();
+}
+
+const char *RingBuffer::lend(int length)
+{
+    Q_ASSERT(!m_pinned && m_retired.isNull());
+    int contiguous = 0;
+    const char *data = readPointer(&contiguous);
+    Q_ASSERT(length <= contiguous);
+    length = qMin(length, contiguous);
+
+    m_size -= length;
+    if (length > 0)
+        m_head = (m_head + length) % m_data.size();
+    m_pinned = length;
+    return data;
+}
+
+void RingBuffer::release()
+{
+    m_pinned = 0;
+    m_retired = QByteArray();
+    if (m_size == 0)
+        m_head = 0;
+}
+
+} // namespace VLC
+} // namespace Phonon
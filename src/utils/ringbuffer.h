@@ -0,0 +1,103 @@
+/*
+    Copyright (C) 2026 vlc-phonon AUTHORS <kde-multimedia@kde.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PHONON_VLC_RINGBUFFER_H
+#define PHONON_VLC_RINGBUFFER_H
+
+#include <QtCore/QByteArray>
+
+namespace Phonon {
+namespace VLC {
+
+/**
+ * \brief Byte FIFO with separate read and write cursors.
+ *
+ * Unlike a plain QByteArray which needs to be trimmed (i.e. copied) from the
+ * front every time data is taken out, reading from a RingBuffer only costs the
+ * bytes that are actually returned. Appending is amortized O(1): when the
+ * buffer runs full it doubles its capacity, linearizing the content once.
+ *
+ * The class is not thread-safe, the owner is expected to serialize access.
+ */
+class RingBuffer
+{
+public:
+    explicit RingBuffer(int capacity = 0);
+
+    /// \returns number of readable bytes
+    int size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+
+    /// \returns number of bytes that can be stored without reallocating
+    int capacity() const { return m_data.size(); }
+
+    /// Drops all content, the capacity is retained.
+    void clear();
+
+    /// Makes sure at least \p capacity bytes fit into the buffer.
+    void reserve(int capacity);
+
+    void append(const char *data, int length);
+    void append(const QByteArray &data) { append(data.constData(), data.size()); }
+
+    /**
+     * Copies up to \p maxLength bytes into \p data and consumes them.
+     * \returns number of bytes copied
+     */
+    int read(char *data, int maxLength);
+
+    /**
+     * \returns pointer to the first readable byte and sets \p length to the
+     * amount of bytes readable from it without wrapping around.
+     * The pointer stays valid until the next append() or reserve().
+     */
+    const char *readPointer(int *length) const;
+
+    /// Consumes \p length bytes without copying them anywhere.
+    void skip(int length);
+
+    /**
+     * Consumes \p length bytes but keeps their memory pinned so it can be
+     * handed out without copying. The region must be contiguous, i.e. at most
+     * the length returned by readPointer(). Appending never overwrites the
+     * pinned region, should the buffer need to grow the old storage is kept
+     * alive instead. Only one region may be lent at any given time, reading
+     * on meanwhile is fine.
+     *
+     * \returns pointer to the lent region
+     * \see release()
+     */
+    const char *lend(int length);
+
+    /// Unpins the region previously returned by lend().
+    void release();
+
+private:
+    QByteArray m_data;
+    /// Storage that got replaced by reserve() while a region was lent.
+    QByteArray m_retired;
+    int m_head;
+    int m_size;
+    /// Bytes directly in front of m_head that must not be written, the lent
+    /// region and all consumed after it.
+    int m_pinned;
+};
+
+} // namespace VLC
+} // namespace Phonon
+
+#endif // PHONON_VLC_RINGBUFFER_H
@@ -0,0 +1,107 @@
+/*
+    Copyright (C) 2026 vlc-phonon AUTHORS <kde-multimedia@kde.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PHONON_VLC_SPSCQUEUE_H
+#define PHONON_VLC_SPSCQUEUE_H
+
+#include <QtCore/QAtomicPointer>
+
+#include <utility>
+
+namespace Phonon {
+namespace VLC {
+
+/**
+ * \brief Unbounded lock-free queue for exactly one producer and one consumer.
+ *
+ * enqueue() must only ever be called from the producer thread, dequeue() and
+ * isEmpty() only from the consumer thread. Neither side ever blocks or takes
+ * a lock, so blocking when the queue is empty is up to the user (e.g. through
+ * a QSemaphore).
+ *
+ * The queue is a singly linked list with a stub node: the consumer owns the
+ * node it last dequeued, the producer only ever touches the last node.
+ */
+template<typename T>
+class SpscQueue
+{
+public:
+    SpscQueue()
+        : m_first(new Node)
+        , m_last(m_first)
+    {
+    }
+
+    ~SpscQueue()
+    {
+        while (m_first) {
+            Node *next = m_first->next.loadRelaxed();
+            delete m_first;
+            m_first = next;
+        }
+    }
+
+    /// Producer side.
+    void enqueue(const T &value)
+    {
+        Node *node = new Node;
+        node->value = value;
+        // Publishing the node makes the value visible to the consumer.
+        m_last->next.storeRelease(node);
+        m_last = node;
+    }
+
+    /// Consumer side. \returns \c false if the queue was empty
+    bool dequeue(T *value)
+    {
+        Node *next = m_first->next.loadAcquire();
+        if (!next) {
+            return false;
+        }
+        *value = std::move(next->value);
+        next->value = T();
+        delete m_first;
+        m_first = next; // next becomes the new stub
+        return true;
+    }
+
+    /// Consumer side.
+    bool isEmpty() const
+    {
+        return !m_first->next.loadAcquire();
+    }
+
+private:
+    Q_DISABLE_COPY(SpscQueue)
+
+    struct Node
+    {
+        Node() : next(nullptr) {}
+        QAtomicPointer<Node> next;
+        T value;
+    };
+
+    /// Consumer owned stub, its successor is the next value to dequeue.
+    Node *m_first;
+    /// Producer owned tail.
+    Node *m_last;
+};
+
+} // namespace VLC
+} // namespace Phonon
+
+#endif // PHONON_VLC_SPSCQUEUE_H
@@ -0,0 +1,347 @@
+/*
+    Copyright (C) 2026 vlc-phonon AUTHORS <kde-multimedia@kde.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pixelconversion.h"
+
+#include <QtCore/QVarLengthArray>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define PIXELCONVERSION_SSSE3
+#  define PIXELCONVERSION_TARGET_SSE2 __attribute__((target("sse2")))
+#  define PIXELCONVERSION_TARGET_SSSE3 __attribute__((target("ssse3")))
+#  define PIXELCONVERSION_TARGET_AVX2 __attribute__((target("avx2")))
+#  include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#  define PIXELCONVERSION_SSSE3
+#  define PIXELCONVERSION_TARGET_SSE2
+#  define PIXELCONVERSION_TARGET_SSSE3
+#  define PIXELCONVERSION_TARGET_AVX2
+#  include <intrin.h>
+#  include <immintrin.h>
+#elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+#  define PIXELCONVERSION_NEON
+#  include <arm_neon.h>
+#endif
+
+// BT.601 limited range to RGB, coefficients in 10.6 fixed point:
+// R = 1.164 (Y - 16) + 1.596 (V - 128)
+// G = 1.164 (Y - 16) - 0.391 (U - 128) - 0.813 (V - 128)
+// B = 1.164 (Y - 16) + 2.018 (U - 128)
+// All vector implementations saturate at 16 bit which yields the same
+// results as the scalar one after clamping.
+#define YUV_Y 74
+#define YUV_RV 102
+#define YUV_GU 25
+#define YUV_GV 52
+#define YUV_BU 129
+#define YUV_SHIFT 6
+
+namespace Phonon {
+namespace VLC {
+
+typedef void (*SwapRowFunction)(uchar *row, int pixels);
+
+static void swapRedBlue24Row(uchar *row, int pixels)
+{
+    for (int i = 0; i < pixels; ++i, row += 3) {
+        const uchar tmp = row[0];
+        row[0] = row[2];
+        row[2] = tmp;
+    }
+}
+
+typedef void (*YuvRowFunction)(const uchar *y, const uchar *u, const uchar *v, uchar *rgb, int pixels);
+
+static inline uchar clampToByte(int value)
+{
+    return static_cast<uchar>(qBound(0, value, 255));
+}
+
+static void yuvToRgb32Row(const uchar *y, const uchar *u, const uchar *v, uchar *rgb, int pixels)
+{
+    quint32 *pixel = reinterpret_cast<quint32 *>(rgb);
+    for (int i = 0; i < pixels; ++i) {
+        const int luma = YUV_Y * (y[i] - 16) + (1 << (YUV_SHIFT - 1));
+        const int cb = u[i] - 128;
+        const int cr = v[i] - 128;
+        const uchar r = clampToByte((luma + YUV_RV * cr) >> YUV_SHIFT);
+        const uchar g = clampToByte((luma - YUV_GU * cb - YUV_GV * cr) >> YUV_SHIFT);
+        const uchar b = clampToByte((luma + YUV_BU * cb) >> YUV_SHIFT);
+        pixel[i] = 0xff000000 | (r << 16) | (g << 8) | b;
+    }
+}
+
+#ifdef PIXELCONVERSION_SSSE3
+#if defined(_MSC_VER)
+static bool cpuHasFeature(int leaf, int reg, int bit)
+{
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < leaf)
+        return false;
+    __cpuidex(info, leaf, 0);
+    return info[reg] & (1 << bit);
+}
+
+static bool cpuHasSse2() { return cpuHasFeature(1, 3, 26); }
+static bool cpuHasSsse3() { return cpuHasFeature(1, 2, 9); }
+// Checking the CPU alone is not enough for AVX2, the OS must save the
+// registers too (OSXSAVE and XCR0).
+static bool cpuHasAvx2()
+{
+    return cpuHasFeature(1, 2, 27) && (_xgetbv(0) & 0x6) == 0x6 && cpuHasFeature(7, 1, 5);
+}
+#else
+static bool cpuHasSse2() { return __builtin_cpu_supports("sse2"); }
+static bool cpuHasSsse3() { return __builtin_cpu_supports("ssse3"); }
+static bool cpuHasAvx2() { return __builtin_cpu_supports("avx2"); }
+#endif
+
+// 16 pixels are 48 bytes, i.e. three vectors. Pixels straddle the vector
+// boundaries, so every output vector is shuffled together from its own input
+// vector and the bytes it borrows from its neighbours.
+PIXELCONVERSION_TARGET_SSSE3
+static void swapRedBlue24RowSsse3(uchar *row, int pixels)
+{
+    const __m128i mask00 = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, -128);
+    const __m128i mask01 = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128,
+                                         -128, -128, -128, -128, -128, -128, -128, 1);
+    const __m128i mask10 = _mm_setr_epi8(-128, 15, -128, -128, -128, -128, -128, -128,
+                                         -128, -128, -128, -128, -128, -128, -128, -128);
+    const __m128i mask11 = _mm_setr_epi8(0, -128, 4, 3, 2, 7, 6, 5, 10, 9, 8, 13, 12, 11, -128, 15);
+    const __m128i mask12 = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128,
+                                         -128, -128, -128, -128, -128, -128, 0, -128);
+    const __m128i mask21 = _mm_setr_epi8(14, -128, -128, -128, -128, -128, -128, -128,
+                                         -128, -128, -128, -128, -128, -128, -128, -128);
+    const __m128i mask22 = _mm_setr_epi8(-128, 3, 2, 1, 6, 5, 4, 9, 8, 7, 12, 11, 10, 15, 14, 13);
+
+    int i = 0;
+    for (; i + 16 <= pixels; i += 16, row += 48) {
+        __m128i *vectors = reinterpret_cast<__m128i *>(row);
+        const __m128i a = _mm_loadu_si128(vectors);
+        const __m128i b = _mm_loadu_si128(vectors + 1);
+        const __m128i c = _mm_loadu_si128(vectors + 2);
+        _mm_storeu_si128(vectors, _mm_or_si128(_mm_shuffle_epi8(a, mask00),
+                                               _mm_shuffle_epi8(b, mask01)));
+        _mm_storeu_si128(vectors + 1, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, mask10),
+                                                                _mm_shuffle_epi8(b, mask11)),
+                                                   _mm_shuffle_epi8(c, mask12)));
+        _mm_storeu_si128(vectors + 2, _mm_or_si128(_mm_shuffle_epi8(b, mask21),
+                                                   _mm_shuffle_epi8(c, mask22)));
+    }
+    swapRedBlue24Row(row, pixels - i);
+}
+
+PIXELCONVERSION_TARGET_SSE2
+static void yuvToRgb32RowSse2(const uchar *y, const uchar *u, const uchar *v, uchar *rgb, int pixels)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max = _mm_set1_epi16(255);
+    const __m128i alpha = _mm_set1_epi16(static_cast<short>(0xff00));
+    const __m128i lumaOffset = _mm_set1_epi16(16);
+    const __m128i chromaOffset = _mm_set1_epi16(128);
+    const __m128i rounding = _mm_set1_epi16(1 << (YUV_SHIFT - 1));
+
+    int i = 0;
+    for (; i + 8 <= pixels; i += 8) {
+        const __m128i luma = _mm_adds_epi16(
+                    _mm_mullo_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(y + i)), zero),
+                                                  lumaOffset),
+                                    _mm_set1_epi16(YUV_Y)),
+                    rounding);
+        const __m128i cb = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(u + i)), zero),
+                                         chromaOffset);
+        const __m128i cr = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(v + i)), zero),
+                                         chromaOffset);
+
+        __m128i r = _mm_srai_epi16(_mm_adds_epi16(luma, _mm_mullo_epi16(cr, _mm_set1_epi16(YUV_RV))), YUV_SHIFT);
+        __m128i g = _mm_srai_epi16(_mm_subs_epi16(_mm_subs_epi16(luma, _mm_mullo_epi16(cb, _mm_set1_epi16(YUV_GU))),
+                                                  _mm_mullo_epi16(cr, _mm_set1_epi16(YUV_GV))), YUV_SHIFT);
+        __m128i b = _mm_srai_epi16(_mm_adds_epi16(luma, _mm_mullo_epi16(cb, _mm_set1_epi16(YUV_BU))), YUV_SHIFT);
+        r = _mm_min_epi16(_mm_max_epi16(r, zero), max);
+        g = _mm_min_epi16(_mm_max_epi16(g, zero), max);
+        b = _mm_min_epi16(_mm_max_epi16(b, zero), max);
+
+        // Little endian RGB32 is B, G, R, A in memory.
+        const __m128i bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+        const __m128i ra = _mm_or_si128(r, alpha);
+        __m128i *out = reinterpret_cast<__m128i *>(rgb + 4 * i);
+        _mm_storeu_si128(out, _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(bg, ra));
+    }
+    yuvToRgb32Row(y + i, u + i, v + i, rgb + 4 * i, pixels - i);
+}
+
+PIXELCONVERSION_TARGET_AVX2
+static void yuvToRgb32RowAvx2(const uchar *y, const uchar *u, const uchar *v, uchar *rgb, int pixels)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max = _mm256_set1_epi16(255);
+    const __m256i alpha = _mm256_set1_epi16(static_cast<short>(0xff00));
+    const __m256i lumaOffset = _mm256_set1_epi16(16);
+    const __m256i chromaOffset = _mm256_set1_epi16(128);
+    const __m256i rounding = _mm256_set1_epi16(1 << (YUV_SHIFT - 1));
+
+    int i = 0;
+    for (; i + 16 <= pixels; i += 16) {
+        const __m256i luma = _mm256_adds_epi16(
+                    _mm256_mullo_epi16(_mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(y + i))),
+                                                        lumaOffset),
+                                       _mm256_set1_epi16(YUV_Y)),
+                    rounding);
+        const __m256i cb = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(u + i))),
+                                            chromaOffset);
+        const __m256i cr = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(v + i))),
+                                            chromaOffset);
+
+        __m256i r = _mm256_srai_epi16(_mm256_adds_epi16(luma, _mm256_mullo_epi16(cr, _mm256_set1_epi16(YUV_RV))), YUV_SHIFT);
+        __m256i g = _mm256_srai_epi16(_mm256_subs_epi16(_mm256_subs_epi16(luma, _mm256_mullo_epi16(cb, _mm256_set1_epi16(YUV_GU))),
+                                                        _mm256_mullo_epi16(cr, _mm256_set1_epi16(YUV_GV))), YUV_SHIFT);
+        __m256i b = _mm256_srai_epi16(_mm256_adds_epi16(luma, _mm256_mullo_epi16(cb, _mm256_set1_epi16(YUV_BU))), YUV_SHIFT);
+        r = _mm256_min_epi16(_mm256_max_epi16(r, zero), max);
+        g = _mm256_min_epi16(_mm256_max_epi16(g, zero), max);
+        b = _mm256_min_epi16(_mm256_max_epi16(b, zero), max);
+
+        const __m256i bg = _mm256_or_si256(b, _mm256_slli_epi16(g, 8));
+        const __m256i ra = _mm256_or_si256(r, alpha);
+        // Unpacking works per 128 bit lane: low holds pixels 0-3 and 8-11,
+        // high holds 4-7 and 12-15. Swap the middle quarters back in order.
+        const __m256i low = _mm256_unpacklo_epi16(bg, ra);
+        const __m256i high = _mm256_unpackhi_epi16(bg, ra);
+        __m256i *out = reinterpret_cast<__m256i *>(rgb + 4 * i);
+        _mm256_storeu_si256(out, _mm256_permute2x128_si256(low, high, 0x20));
+        _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(low, high, 0x31));
+    }
+    yuvToRgb32RowSse2(y + i, u + i, v + i, rgb + 4 * i, pixels - i);
+}
+#endif // PIXELCONVERSION_SSSE3
+
+#ifdef PIXELCONVERSION_NEON
+static void swapRedBlue24RowNeon(uchar *row, int pixels)
+{
+    int i = 0;
+    for (; i + 16 <= pixels; i += 16, row += 48) {
+        // De-interleaving the channels makes the swap a matter of register naming.
+        uint8x16x3_t rgb = vld3q_u8(row);
+        const uint8x16_t tmp = rgb.val[0];
+        rgb.val[0] = rgb.val[2];
+        rgb.val[2] = tmp;
+        vst3q_u8(row, rgb);
+    }
+    swapRedBlue24Row(row, pixels - i);
+}
+
+static void yuvToRgb32RowNeon(const uchar *y, const uchar *u, const uchar *v, uchar *rgb, int pixels)
+{
+    int i = 0;
+    for (; i + 8 <= pixels; i += 8) {
+        const int16x8_t luma = vmulq_n_s16(vreinterpretq_s16_u16(vsubl_u8(vld1_u8(y + i), vdup_n_u8(16))), YUV_Y);
+        const int16x8_t cb = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(u + i), vdup_n_u8(128)));
+        const int16x8_t cr = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(v + i), vdup_n_u8(128)));
+
+        const int16x8_t r = vqaddq_s16(luma, vmulq_n_s16(cr, YUV_RV));
+        const int16x8_t g = vqsubq_s16(vqsubq_s16(luma, vmulq_n_s16(cb, YUV_GU)), vmulq_n_s16(cr, YUV_GV));
+        const int16x8_t b = vqaddq_s16(luma, vmulq_n_s16(cb, YUV_BU));
+
+        // The rounding shift cannot overflow, the narrowing saturates.
+        uint8x8x4_t bgra;
+        bgra.val[0] = vqmovun_s16(vrshrq_n_s16(b, YUV_SHIFT));
+        bgra.val[1] = vqmovun_s16(vrshrq_n_s16(g, YUV_SHIFT));
+        bgra.val[2] = vqmovun_s16(vrshrq_n_s16(r, YUV_SHIFT));
+        bgra.val[3] = vdup_n_u8(0xff);
+        vst4_u8(rgb + 4 * i, bgra);
+    }
+    yuvToRgb32Row(y + i, u + i, v + i, rgb + 4 * i, pixels - i);
+}
+#endif // PIXELCONVERSION_NEON
+
+static SwapRowFunction swapRedBlue24RowFunction()
+{
+#if defined(PIXELCONVERSION_SSSE3)
+    if (cpuHasSsse3())
+        return swapRedBlue24RowSsse3;
+#elif defined(PIXELCONVERSION_NEON)
+    return swapRedBlue24RowNeon;
+#endif
+    return swapRedBlue24Row;
+}
+
+static YuvRowFunction yuvToRgb32RowFunction()
+{
+#if defined(PIXELCONVERSION_SSSE3)
+    if (cpuHasAvx2())
+        return yuvToRgb32RowAvx2;
+    if (cpuHasSse2())
+        return yuvToRgb32RowSse2;
+#elif defined(PIXELCONVERSION_NEON)
+    return yuvToRgb32RowNeon;
+#endif
+    return yuvToRgb32Row;
+}
+
+void swapRedBlue24(uchar *data, int width, int height, int pitch)
+{
+    static const SwapRowFunction swapRow = swapRedBlue24RowFunction();
+    for (int y = 0; y < height; ++y) {
+        swapRow(data + y * pitch, width);
+    }
+}
+
+void convertYuv420ToRgb32(const uchar *luma, int lumaPitch,
+                          const uchar *cb, const uchar *cr, int chromaPitch, int chromaStep,
+                          int width, int height,
+                          uchar *target, int targetPitch, int targetWidth, int targetHeight)
+{
+    static const YuvRowFunction convertRow = yuvToRgb32RowFunction();
+    if (width <= 0 || height <= 0 || targetWidth <= 0 || targetHeight <= 0)
+        return;
+
+    // Source column of every target column, sampled at the pixel centers.
+    QVarLengthArray<int, 2048> columns(targetWidth);
+    for (int x = 0; x < targetWidth; ++x)
+        columns[x] = static_cast<int>((2 * qint64(x) + 1) * width / (2 * qint64(targetWidth)));
+
+    // Upsampled chroma and, when scaling, luma of one target line.
+    QVarLengthArray<uchar, 3 * 2048> lineBuffer(3 * targetWidth);
+    uchar *lineY = lineBuffer.data();
+    uchar *lineU = lineY + targetWidth;
+    uchar *lineV = lineU + targetWidth;
+    const bool scaleColumns = targetWidth != width;
+
+    for (int ty = 0; ty < targetHeight; ++ty) {
+        const int sy = static_cast<int>((2 * qint64(ty) + 1) * height / (2 * qint64(targetHeight)));
+        const uchar *rowY = luma + sy * lumaPitch;
+        const uchar *rowU = cb + (sy / 2) * chromaPitch;
+        const uchar *rowV = cr + (sy / 2) * chromaPitch;
+
+        for (int x = 0; x < targetWidth; ++x) {
+            const int chroma = (columns[x] / 2) * chromaStep;
+            lineU[x] = rowU[chroma];
+            lineV[x] = rowV[chroma];
+        }
+        if (scaleColumns) {
+            for (int x = 0; x < targetWidth; ++x)
+                lineY[x] = rowY[columns[x]];
+            rowY = lineY;
+        }
+
+        convertRow(rowY, lineU, lineV, target + ty * targetPitch, targetWidth);
+    }
+}
+
+} // namespace VLC
+} // namespace Phonon
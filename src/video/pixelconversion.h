@@ -0,0 +1,71 @@
+/*
+    Copyright (C) 2026 vlc-phonon AUTHORS <kde-multimedia@kde.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PHONON_VLC_PIXELCONVERSION_H
+#define PHONON_VLC_PIXELCONVERSION_H
+
+#include <QtCore/QtGlobal>
+
+namespace Phonon {
+namespace VLC {
+
+/**
+ * Swaps the first and the third byte of every pixel of a packed 24 bit
+ * picture in place, i.e. converts BGR24 to RGB24 and vice versa.
+ *
+ * Uses SSSE3 or NEON where the CPU supports it, the implementation is picked
+ * once at runtime.
+ *
+ * \param data first byte of the picture
+ * \param width number of pixels per line
+ * \param height number of lines
+ * \param pitch distance between the start of two lines in bytes
+ */
+void swapRedBlue24(uchar *data, int width, int height, int pitch);
+
+/**
+ * Converts a 4:2:0 YUV picture (BT.601, limited range) to RGB32 as used by
+ * QImage::Format_RGB32 and scales it to the target size on the way, the
+ * whole conversion is a single pass over the target.
+ *
+ * Scaling samples the nearest pixel. Each target line is gathered into a
+ * small line buffer first, the colour conversion then runs with AVX2, SSE2
+ * or NEON as supported by the CPU, picked once at runtime.
+ *
+ * \param luma first byte of the Y plane
+ * \param lumaPitch distance between two lines of the Y plane in bytes
+ * \param cb first byte of the U plane
+ * \param cr first byte of the V plane
+ * \param chromaPitch distance between two lines of the chroma planes in bytes
+ * \param chromaStep distance between two chroma samples in bytes, 1 for
+ *        planar I420, 2 for semi-planar NV12 (\p cr then being \p cb + 1)
+ * \param width source width in pixels
+ * \param height source height in pixels
+ * \param target first pixel of the target
+ * \param targetPitch distance between two lines of the target in bytes
+ * \param targetWidth target width in pixels
+ * \param targetHeight target height in pixels
+ */
+void convertYuv420ToRgb32(const uchar *luma, int lumaPitch,
+                          const uchar *cb, const uchar *cr, int chromaPitch, int chromaStep,
+                          int width, int height,
+                          uchar *target, int targetPitch, int targetWidth, int targetHeight);
+
+} // namespace VLC
+} // namespace Phonon
+
+#endif // PHONON_VLC_PIXELCONVERSION_H
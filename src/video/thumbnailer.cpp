@@ -0,0 +1,446 @@
+/*
+    Copyright (C) 2026 vlc-phonon AUTHORS <kde-multimedia@kde.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "thumbnailer.h"
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QFileInfo>
+#include <QtCore/QThread>
+
+#include "utils/debug.h"
+#include "media.h"
+
+#include "video/pixelconversion.h"
+#include "video/videomemorystream.h"
+
+// Default size frames get scaled into.
+#define THUMBNAIL_SIZE QSize(160, 120)
+// Time in msec after which a frame counts as not extractable.
+#define THUMBNAIL_TIMEOUT 5000
+// Slack behind the frame for conversion kernels reading past a line end.
+#define THUMBNAIL_PADDING 16
+// Playback rate, so the frame after a seek is not held back until its time.
+#define THUMBNAIL_RATE 8.0f
+
+namespace Phonon {
+namespace VLC {
+
+/**
+ * Receives the decoded video of a ThumbnailWorker's player and converts one
+ * frame per arm() to a QImage.
+ *
+ * VLC decodes into a single buffer, allocated at the first format negotiation
+ * and reused as long as the size fits. vmem copies into it, displays it and
+ * only then locks it for the next picture, all from the same vout thread.
+ */
+class ThumbnailSink : public VideoMemoryStream
+{
+public:
+    explicit ThumbnailSink(ThumbnailWorker *worker)
+        : m_worker(worker)
+        , m_armed(0)
+    {
+        for (int i = 0; i < 3; ++i)
+            m_offsets[i] = m_pitches[i] = 0;
+    }
+
+    /// Sets the size frames get scaled into, only call while the player is stopped.
+    void setBounds(const QSize &bounds) { m_bounds = bounds; }
+
+    /// Captures the next displayed frame for the seek identified by \p generation.
+    void arm(int generation) { m_armed.storeRelease(generation); }
+
+    void disarm() { m_armed.storeRelease(0); }
+
+private:
+    void *lockCallback(void **planes) override
+    {
+        uchar *frame = reinterpret_cast<uchar *>(m_buffer.data());
+        for (int i = 0; i < 3; ++i)
+            planes[i] = frame + m_offsets[i];
+        return 0;
+    }
+
+    void unlockCallback(void *picture, void *const *planes) override
+    {
+        Q_UNUSED(picture);
+        Q_UNUSED(planes);
+    }
+
+    void displayCallback(void *picture) override
+    {
+        Q_UNUSED(picture);
+        // Frames in between seeks are dropped right here, unconverted.
+        const int generation = m_armed.fetchAndStoreOrdered(0);
+        if (!generation)
+            return;
+
+        QImage image(m_size, QImage::Format_RGB32);
+        const uchar *frame = reinterpret_cast<const uchar *>(m_buffer.constData());
+        convertYuv420ToRgb32(frame + m_offsets[0], m_pitches[0],
+                             frame + m_offsets[1], frame + m_offsets[2], m_pitches[1], 1,
+                             m_size.width(), m_size.height(),
+                             image.bits(), image.bytesPerLine(), image.width(), image.height());
+        QMetaObject::invokeMethod(m_worker, "frameCaptured", Qt::QueuedConnection,
+                                  Q_ARG(int, generation), Q_ARG(QImage, image));
+    }
+
+    unsigned formatCallback(char *chroma,
+                            unsigned *width, unsigned *height,
+                            unsigned *pitches,
+                            unsigned *lines) override
+    {
+        // Let VLC scale down, so decoding is the only full size work.
+        m_size = fittedSize(QSize(*width, *height), m_bounds);
+        *width = m_size.width();
+        *height = m_size.height();
+
+        qstrcpy(chroma, "I420");
+        const unsigned bufferSize = setPitchAndLines(VLC_CODEC_I420, *width, *height, pitches, lines);
+        m_offsets[0] = 0;
+        m_offsets[1] = pitches[0] * lines[0];
+        m_offsets[2] = m_offsets[1] + pitches[1] * lines[1];
+        m_pitches[0] = pitches[0];
+        m_pitches[1] = m_pitches[2] = pitches[1];
+
+        if (unsigned(m_buffer.size()) < bufferSize + THUMBNAIL_PADDING)
+            m_buffer = QByteArray(bufferSize + THUMBNAIL_PADDING, Qt::Uninitialized);
+
+        return bufferSize;
+    }
+
+    void formatCleanUpCallback() override
+    {
+    }
+
+    /**
+     * \returns \p source scaled down to fit into \p bounds keeping its
+     * aspect ratio, never scaled up.
+     */
+    static QSize fittedSize(const QSize &source, const QSize &bounds)
+    {
+        if (bounds.isEmpty() || source.isEmpty() ||
+                (source.width() <= bounds.width() && source.height() <= bounds.height()))
+            return source;
+        const QSize size = source.scaled(bounds, Qt::KeepAspectRatio);
+        return QSize(qMax(1, size.width()), qMax(1, size.height()));
+    }
+
+    ThumbnailWorker *m_worker;
+    QSize m_bounds;
+    QAtomicInt m_armed;
+
+    QByteArray m_buffer;
+    QSize m_size;
+    int m_offsets[3];
+    int m_pitches[3];
+};
+
+Thumbnailer::Thumbnailer(QObject *parent)
+    : QObject(parent)
+    , m_size(THUMBNAIL_SIZE)
+    , m_workerCount(qMax(1, QThread::idealThreadCount()))
+{
+}
+
+Thumbnailer::~Thumbnailer()
+{
+    qDeleteAll(m_workers);
+}
+
+void Thumbnailer::setSize(const QSize &size)
+{
+    m_size = size;
+}
+
+void Thumbnailer::setWorkerCount(int count)
+{
+    // Surplus workers go away once they are done.
+    m_workerCount = qMax(1, count);
+    startJobs();
+}
+
+void Thumbnailer::extract(const QUrl &url, const QList<qint64> &times)
+{
+    if (times.isEmpty())
+        return;
+
+    Job job;
+    job.url = url;
+    job.times = times;
+    m_jobs.enqueue(job);
+    startJobs();
+}
+
+void Thumbnailer::cancel()
+{
+    DEBUG_BLOCK;
+    m_jobs.clear();
+    foreach (ThumbnailWorker *worker, m_workers) {
+        if (worker->isBusy())
+            worker->abort();
+    }
+    emit finished();
+}
+
+void Thumbnailer::startJobs()
+{
+    for (int i = 0; i < m_workers.size() && !m_jobs.isEmpty(); ++i) {
+        if (!m_workers.at(i)->isBusy()) {
+            const Job job = m_jobs.dequeue();
+            m_workers.at(i)->start(job.url, job.times, m_size);
+        }
+    }
+    while (!m_jobs.isEmpty() && m_workers.size() < m_workerCount) {
+        ThumbnailWorker *worker = new ThumbnailWorker(this);
+        m_workers.append(worker);
+        const Job job = m_jobs.dequeue();
+        worker->start(job.url, job.times, m_size);
+    }
+}
+
+void Thumbnailer::deliver(const QUrl &url, qint64 time, const QImage &image)
+{
+    if (m_callback)
+        m_callback(url, time, image);
+    emit thumbnailReady(url, time, image);
+}
+
+void Thumbnailer::workerFinished(ThumbnailWorker *worker)
+{
+    if (m_workers.size() > m_workerCount) {
+        m_workers.removeOne(worker);
+        // We are called from one of its slots.
+        worker->deleteLater();
+    }
+    startJobs();
+
+    if (m_jobs.isEmpty()) {
+        foreach (ThumbnailWorker *other, m_workers) {
+            if (other->isBusy())
+                return;
+        }
+        emit finished();
+    }
+}
+
+ThumbnailWorker::ThumbnailWorker(Thumbnailer *thumbnailer)
+    : QObject(thumbnailer)
+    , m_thumbnailer(thumbnailer)
+    , m_player(0)
+    , m_sink(0)
+    , m_media(0)
+    , m_seekOrigin(0)
+    , m_seeking(false)
+    , m_armed(false)
+    , m_generation(0)
+{
+    m_timeout.setSingleShot(true);
+    m_timeout.setInterval(THUMBNAIL_TIMEOUT);
+    connect(&m_timeout, SIGNAL(timeout()), this, SLOT(onTimeout()));
+}
+
+ThumbnailWorker::~ThumbnailWorker()
+{
+    if (m_media)
+        abort();
+}
+
+void ThumbnailWorker::start(const QUrl &url, const QList<qint64> &times, const QSize &size)
+{
+    debug() << "extracting" << times.size() << "frames from" << url;
+    m_url = url;
+    m_times = times;
+
+    QByteArray mrl;
+    if (url.scheme().isEmpty())
+        mrl = QUrl::fromLocalFile(QFileInfo(url.toString()).absoluteFilePath()).toEncoded();
+    else
+        mrl = url.toEncoded();
+
+    m_media = new Media(mrl, this);
+    m_media->addOption(QLatin1String(":no-audio"));
+    m_media->addOption(QLatin1String(":no-spu"));
+    m_media->addOption(QLatin1String(":no-sub-autodetect-file"));
+    // Keyframes are good enough for previews and way faster to get to. VLC 4
+    // is asked per seek instead (see MediaPlayer::setTime()).
+    m_media->addOption(QLatin1String(":input-fast-seek"));
+    // Parallelism comes from the workers, decoding threads of their own would
+    // merely compete with them.
+    m_media->addOption(QLatin1String(":avcodec-threads=1"));
+    // Played faster than real time every decoded frame is late, none of them
+    // may get dropped.
+    m_media->addOption(QLatin1String(":no-drop-late-frames"));
+    m_media->addOption(QLatin1String(":no-skip-frames"));
+
+    // A player of its own per media, so aborting never has to wait for the
+    // previous one to stop.
+    m_player = new MediaPlayer(this);
+    m_sink = new ThumbnailSink(this);
+    m_sink->setCallbacks(m_player);
+    connect(m_player, SIGNAL(stateChanged(MediaPlayer::State)),
+            this, SLOT(onStateChanged(MediaPlayer::State)));
+    connect(m_player, SIGNAL(timeChanged(qint64)),
+            this, SLOT(onTimeChanged(qint64)));
+
+    m_bounds = size;
+    m_sink->setBounds(size);
+    m_seeking = false;
+    m_armed = false;
+    m_player->setMedia(m_media);
+    libvlc_media_player_set_rate(*m_player, THUMBNAIL_RATE);
+    m_player->play();
+    m_timeout.start();
+}
+
+void ThumbnailWorker::abort()
+{
+    m_times.clear();
+    m_timeout.stop();
+    if (m_player) {
+        m_sink->disarm();
+        // The vout thread may use the sink until the player is stopped.
+        ThumbnailSink *sink = m_sink;
+        m_player->stopAndDelete([sink]() { delete sink; });
+        m_player = 0;
+        m_sink = 0;
+    }
+    delete m_media;
+    m_media = 0;
+}
+
+void ThumbnailWorker::frameCaptured(int generation, const QImage &image)
+{
+    // Frames of seeks which timed out or got aborted arrive late, if at all.
+    if (!m_media || !m_seeking || generation != m_generation)
+        return;
+
+    m_seeking = false;
+    m_thumbnailer->deliver(m_url, m_times.takeFirst(), correctAspectRatio(image));
+    seekNext();
+}
+
+QImage ThumbnailWorker::correctAspectRatio(const QImage &image) const
+{
+    // VLC scales the stored picture, anamorphic pixels are not square.
+    const qreal sar = m_media->sampleAspectRatio();
+    if (image.isNull() || qFuzzyCompare(sar, qreal(1.0)))
+        return image;
+    QSize size(qMax(1, qRound(image.width() * sar)), image.height());
+    if (!m_bounds.isEmpty() && (size.width() > m_bounds.width() || size.height() > m_bounds.height()))
+        size.scale(m_bounds, Qt::KeepAspectRatio);
+    return image.scaled(size.expandedTo(QSize(1, 1)), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+}
+
+void ThumbnailWorker::onStateChanged(MediaPlayer::State state)
+{
+    if (!m_media)
+        return;
+
+    switch (state) {
+    case MediaPlayer::PlayingState: {
+        if (m_seeking)
+            break;
+        // Without video every timestamp would wait for the timeout.
+        int audio = 0;
+        int video = 0;
+        int subtitle = 0;
+        m_media->trackCounts(&audio, &video, &subtitle);
+        if (!video) {
+            warning() << "no video in" << m_url;
+            while (!m_times.isEmpty())
+                m_thumbnailer->deliver(m_url, m_times.takeFirst(), QImage());
+            finish();
+            break;
+        }
+        seekNext();
+        break;
+    }
+    case MediaPlayer::EndedState:
+    case MediaPlayer::ErrorState:
+        // Whatever is left lies beyond the end or is unreachable.
+        while (!m_times.isEmpty())
+            m_thumbnailer->deliver(m_url, m_times.takeFirst(), QImage());
+        finish();
+        break;
+    default:
+        break;
+    }
+}
+
+void ThumbnailWorker::onTimeChanged(qint64 time)
+{
+    if (!m_seeking || m_armed)
+        return;
+
+    // Seeks are asynchronous, frames from before the seek may well still be
+    // on their way out. Once the time reported is closer to the target than
+    // to where we came from the input has been flushed, so the next frame
+    // displayed is from the keyframe we seeked to.
+    const qint64 target = m_times.first();
+    if (qAbs(time - target) <= qAbs(time - m_seekOrigin)) {
+        m_armed = true;
+        m_sink->arm(m_generation);
+    }
+}
+
+void ThumbnailWorker::onTimeout()
+{
+    if (!m_media)
+        return;
+
+    if (m_times.isEmpty()) {
+        finish();
+        return;
+    }
+    warning() << "no frame at" << m_times.first() << "of" << m_url;
+    m_seeking = false;
+    m_thumbnailer->deliver(m_url, m_times.takeFirst(), QImage());
+    seekNext();
+}
+
+void ThumbnailWorker::seekNext()
+{
+    m_sink->disarm();
+    if (m_times.isEmpty()) {
+        finish();
+        return;
+    }
+
+    const qint64 target = m_times.first();
+    ++m_generation;
+    m_seeking = true;
+    m_armed = false;
+    m_seekOrigin = m_player->time();
+    m_player->setTime(target, true);
+    m_timeout.start();
+
+    // Already there, e.g. a frame at the very beginning.
+    if (target == m_seekOrigin) {
+        m_armed = true;
+        m_sink->arm(m_generation);
+    }
+}
+
+void ThumbnailWorker::finish()
+{
+    abort();
+    m_thumbnailer->workerFinished(this);
+}
+
+} // namespace VLC
+} // namespace Phonon
@@ -0,0 +1,178 @@
+/*
+    Copyright (C) 2026 vlc-phonon AUTHORS <kde-multimedia@kde.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PHONON_VLC_THUMBNAILER_H
+#define PHONON_VLC_THUMBNAILER_H
+
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QQueue>
+#include <QtCore/QSize>
+#include <QtCore/QTimer>
+#include <QtCore/QUrl>
+#include <QtCore/QVector>
+#include <QtGui/QImage>
+
+#include <functional>
+
+#include "mediaplayer.h"
+
+namespace Phonon {
+namespace VLC {
+
+class Media;
+class ThumbnailSink;
+class ThumbnailWorker;
+
+/**
+ * \brief Headless extraction of video frames, e.g. for preview strips.
+ *
+ * Every media gets opened in a muted MediaPlayer of its own, which seeks to
+ * the requested timestamps with fast (i.e. keyframe) seeking and plays faster
+ * than real time. VLC scales the video down to the requested size and only
+ * the frames actually taken get converted to RGB, all other frames are
+ * merely decoded. Media without video fail right away.
+ *
+ * Several media are processed in parallel, one player each. Decoding and
+ * conversion happen in the VLC threads of the players, everything else in
+ * the thread the thumbnailer lives in, which needs an event loop. Results
+ * are delivered in that thread as well.
+ */
+class Thumbnailer : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QSize size READ size WRITE setSize)
+    Q_PROPERTY(int workerCount READ workerCount WRITE setWorkerCount)
+public:
+    /**
+     * Receives the frame at \p time (in msec) of \p url, scaled to fit
+     * size(). \p image is null if the frame could not be extracted.
+     */
+    typedef std::function<void (const QUrl &url, qint64 time, const QImage &image)> Callback;
+
+    explicit Thumbnailer(QObject *parent = nullptr);
+    ~Thumbnailer();
+
+    /// \returns the size frames get scaled down into
+    QSize size() const { return m_size; }
+
+    /**
+     * Sets the size frames get scaled down into, keeping their aspect ratio.
+     * Only applies to media started afterwards.
+     */
+    void setSize(const QSize &size);
+
+    /// \returns how many media get processed in parallel
+    int workerCount() const { return m_workerCount; }
+
+    /// Sets how many media get processed in parallel, defaults to one per core.
+    void setWorkerCount(int count);
+
+    void setCallback(const Callback &callback) { m_callback = callback; }
+
+    /**
+     * Queues extraction of the frames at \p times (in msec) of \p url.
+     * Frames get delivered in the order of \p times, ascending times need
+     * the least seeking.
+     */
+    Q_INVOKABLE void extract(const QUrl &url, const QList<qint64> &times);
+
+    /// Drops all queued media and aborts the running ones.
+    Q_INVOKABLE void cancel();
+
+Q_SIGNALS:
+    /// Emitted for every frame, right after the callback was invoked.
+    void thumbnailReady(const QUrl &url, qint64 time, const QImage &image);
+
+    /// Emitted when the last queued media is done.
+    void finished();
+
+private:
+    friend class ThumbnailWorker;
+
+    struct Job
+    {
+        QUrl url;
+        QList<qint64> times;
+    };
+
+    void startJobs();
+    void deliver(const QUrl &url, qint64 time, const QImage &image);
+    void workerFinished(ThumbnailWorker *worker);
+
+    QSize m_size;
+    int m_workerCount;
+    Callback m_callback;
+
+    QQueue<Job> m_jobs;
+    QVector<ThumbnailWorker *> m_workers;
+};
+
+/**
+ * \brief Extracts the frames of one media at a time for the Thumbnailer.
+ */
+class ThumbnailWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ThumbnailWorker(Thumbnailer *thumbnailer);
+    ~ThumbnailWorker();
+
+    bool isBusy() const { return m_media; }
+
+    void start(const QUrl &url, const QList<qint64> &times, const QSize &size);
+
+    /// Stops the current media without delivering its remaining frames.
+    void abort();
+
+private Q_SLOTS:
+    /// Invoked by the sink, \p generation tells which seek \p image belongs to.
+    void frameCaptured(int generation, const QImage &image);
+
+    void onStateChanged(MediaPlayer::State state);
+    void onTimeChanged(qint64 time);
+    void onTimeout();
+
+private:
+    void seekNext();
+    void finish();
+
+    /// \returns \p image stretched for the sample aspect ratio of the media.
+    QImage correctAspectRatio(const QImage &image) const;
+
+    Thumbnailer *m_thumbnailer;
+    MediaPlayer *m_player;
+    ThumbnailSink *m_sink;
+    Media *m_media;
+
+    QUrl m_url;
+    QList<qint64> m_times;
+    QSize m_bounds;
+
+    /// Playback time when the current seek was started.
+    qint64 m_seekOrigin;
+    bool m_seeking;
+    bool m_armed;
+    int m_generation;
+
+    QTimer m_timeout;
+};
+
+} // namespace VLC
+} // namespace Phonon
+
+#endif // PHONON_VLC_THUMBNAILER_H
@@ -26,10 +26,12 @@
 #include <phonon/experimental/abstractvideodataoutput.h>
 
 #include <QMetaObject>
+#include <QMutexLocker>
 
 #include "utils/debug.h"
 #include "media.h"
 #include "mediaobject.h"
+#include "pixelconversion.h"
 
 using namespace Phonon::Experimental;
 
@@ -38,10 +40,20 @@ namespace Phonon
 namespace VLC
 {
 
+// Default number of frames VLC can decode into while consumers hold on to others.
+#define FRAME_POOL_SIZE 3
+
 VideoDataOutput::VideoDataOutput(QObject *parent)
     : QObject(parent)
     , m_frontend(0)
+    , m_lockedFrame(0)
+    , m_nextFrame(0)
+    , m_framePoolSize(FRAME_POOL_SIZE)
+    , m_dropFramesWhenFull(false)
+    , m_droppedFrames(0)
+    , m_swapChromaPlanes(false)
 {
+    m_planeSizes[0] = m_planeSizes[1] = m_planeSizes[2] = 0;
 }
 
 VideoDataOutput::~VideoDataOutput()
@@ -75,62 +87,174 @@ void VideoDataOutput::setFrontendObject(Experimental::AbstractVideoDataOutput *f
     m_frontend = frontend;
 }
 
-void *VideoDataOutput::lockCallback(void **planes)
+int VideoDataOutput::framePoolSize() const
 {
-    m_mutex.lock();
-    DEBUG_BLOCK;
-    planes[0] = reinterpret_cast<void *>(m_frame.data0.data());
-    planes[1] = reinterpret_cast<void *>(m_frame.data1.data());
-    planes[2] = reinterpret_cast<void *>(m_frame.data2.data());
-    return 0;
+    QMutexLocker lock(&m_mutex);
+    return m_framePoolSize;
 }
 
-void VideoDataOutput::unlockCallback(void *picture, void *const*planes)
+void VideoDataOutput::setFramePoolSize(int size)
 {
-    Q_UNUSED(picture);
-    Q_UNUSED(planes);
-    DEBUG_BLOCK;
+    QMutexLocker lock(&m_mutex);
+    m_framePoolSize = qMax(1, size);
+}
+
+bool VideoDataOutput::dropFramesWhenFull() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_dropFramesWhenFull;
+}
+
+void VideoDataOutput::setDropFramesWhenFull(bool drop)
+{
+    QMutexLocker lock(&m_mutex);
+    m_dropFramesWhenFull = drop;
+}
 
-    // For some reason VLC yields BGR24, so we swap it to RGB
-    if (m_frame.format == Experimental::VideoFrame2::Format_RGB888) {
-        uchar *data = (uchar *) m_frame.data0.data();
-        uchar tmp;
-        for (int i = 0; i < m_frame.data0.size(); i += 3) {
-            tmp = data[i];
-            data[i] = data[i+2];
-            data[i+2] = tmp;
+int VideoDataOutput::droppedFrames() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_droppedFrames;
+}
+
+static bool isPlaneFree(const QByteArray &plane)
+{
+    // Unused planes are never written to, whoever shares them.
+    return plane.isEmpty() || plane.isDetached();
+}
+
+Experimental::VideoFrame2 *VideoDataOutput::acquireFrame()
+{
+    for (int i = 0; i < m_frames.size(); ++i) {
+        Experimental::VideoFrame2 *frame = &m_frames[(m_nextFrame + i) % m_frames.size()];
+        if (frame != m_lockedFrame &&
+                isPlaneFree(frame->data0) && isPlaneFree(frame->data1) && isPlaneFree(frame->data2)) {
+            m_nextFrame = (m_nextFrame + i + 1) % m_frames.size();
+            return frame;
         }
     }
 
-    if (m_frontend)
-        m_frontend->frameReady(m_frame);
+    // Consumers hold on to all of our frames.
+    if (m_dropFramesWhenFull) {
+        ++m_droppedFrames;
+        if (m_dropFrame.data0.size() != m_planeSizes[0]) {
+            allocateFrame(&m_dropFrame);
+        }
+        return &m_dropFrame;
+    }
+    // Give the next frame new memory, the consumers keep the old one.
+    Experimental::VideoFrame2 *frame = &m_frames[m_nextFrame];
+    if (frame == m_lockedFrame) {
+        m_nextFrame = (m_nextFrame + 1) % m_frames.size();
+        frame = &m_frames[m_nextFrame];
+    }
+    m_nextFrame = (m_nextFrame + 1) % m_frames.size();
+    allocateFrame(frame);
+    return frame;
+}
 
-    m_mutex.unlock();
+void VideoDataOutput::allocateFrame(Experimental::VideoFrame2 *frame) const
+{
+    *frame = m_frame;
+    frame->data0 = QByteArray(m_planeSizes[0], Qt::Uninitialized);
+    frame->data1 = QByteArray(m_planeSizes[1], Qt::Uninitialized);
+    frame->data2 = QByteArray(m_planeSizes[2], Qt::Uninitialized);
+}
+
+void *VideoDataOutput::lockCallback(void **planes)
+{
+    QMutexLocker lock(&m_mutex);
+    // VLC only ever decodes into one picture at a time. Should the last one
+    // not have been displayed it got dropped, and its frame is free again.
+    Experimental::VideoFrame2 *frame = acquireFrame();
+    m_lockedFrame = frame;
+    // Only we reference the frame, so none of this detaches.
+    planes[0] = reinterpret_cast<void *>(frame->data0.data());
+    if (m_swapChromaPlanes) {
+        // I420 decoded straight into a YV12 frame, see formatCallback().
+        planes[1] = reinterpret_cast<void *>(frame->data2.data());
+        planes[2] = reinterpret_cast<void *>(frame->data1.data());
+    } else {
+        planes[1] = reinterpret_cast<void *>(frame->data1.data());
+        planes[2] = reinterpret_cast<void *>(frame->data2.data());
+    }
+    return frame;
+}
+
+void VideoDataOutput::unlockCallback(void *picture, void *const*planes)
+{
+    Q_UNUSED(planes);
+    Experimental::VideoFrame2 *frame = static_cast<Experimental::VideoFrame2 *>(picture);
+
+#if (LIBVLC_VERSION_INT < LIBVLC_VERSION(4, 0, 0, 0))
+    // vmem forces the RV24 masks to BGR order and there is no chroma for RGB
+    // byte order in VLC 3, so we swap it to RGB. VLC 4 delivers RGB already.
+    // No need to lock, until it gets displayed no one but VLC touches the frame.
+    if (frame->format == Experimental::VideoFrame2::Format_RGB888 && frame->height > 0) {
+        swapRedBlue24(reinterpret_cast<uchar *>(frame->data0.data()),
+                      frame->width, frame->height,
+                      frame->data0.size() / frame->height);
+    }
+#else
+    Q_UNUSED(frame);
+#endif
 }
 
 void VideoDataOutput::displayCallback(void *picture)
 {
-    Q_UNUSED(picture);
-    DEBUG_BLOCK;
-    // We send the frame while unlocking as we could loose syncing otherwise.
-    // With VDO the consumer is expected to ensure syncness while not blocking
-    // unlock for long periods of time. Good luck with that... -.-
+    Experimental::VideoFrame2 *frame = static_cast<Experimental::VideoFrame2 *>(picture);
+    Experimental::VideoFrame2 published;
+    {
+        QMutexLocker lock(&m_mutex);
+        if (m_lockedFrame == frame) {
+            m_lockedFrame = 0;
+        }
+        if (frame == &m_dropFrame) {
+            return;
+        }
+        // Our copy keeps the frame from being reused while the frontend looks
+        // at it, without holding the lock.
+        published = *frame;
+    }
+
+    // The frame is sent when it is due, the consumer is free to keep it.
+    if (m_frontend)
+        m_frontend->frameReady(published);
 }
 
 static VideoFrame2::Format fourccToFormat(const char *fourcc)
 {
-    if (qstrcmp(fourcc, "RV24"))
+    if (qstrcmp(fourcc, "RV24") == 0)
         return VideoFrame2::Format_RGB888;
-    else if (qstrcmp(fourcc, "RV32"))
+    else if (qstrcmp(fourcc, "RV32") == 0)
         return VideoFrame2::Format_RGB32;
-    else if (qstrcmp(fourcc, "YV12"))
+    else if (qstrcmp(fourcc, "YV12") == 0)
         return VideoFrame2::Format_YV12;
-    else if (qstrcmp(fourcc, "YUY2"))
+    else if (qstrcmp(fourcc, "YUY2") == 0)
         return VideoFrame2::Format_YUY2;
     else
         return VideoFrame2::Format_Invalid;
 }
 
+/**
+ * \returns whether \p fourcc is a planar 4:2:0 chroma with the U plane in
+ * front of the V plane. It only differs from YV12 in the plane order.
+ */
+static bool isI420(const char *fourcc)
+{
+    return qstrcmp(fourcc, "I420") == 0 || qstrcmp(fourcc, "J420") == 0;
+}
+
+/**
+ * \returns whether \p fourcc is a YUV chroma. Converting it to YUV rather
+ * than RGB spares the decoder thread a colour space conversion.
+ */
+static bool isYuv(const char *fourcc)
+{
+    return fourcc[0] == 'I' || fourcc[0] == 'J' || fourcc[0] == 'Y' ||
+            qstrncmp(fourcc, "NV", 2) == 0 || qstrcmp(fourcc, "UYVY") == 0;
+}
+
 static uint32_t setFormat(VideoFrame2::Format format, char **chroma)
 {
     switch (format) {
@@ -158,20 +282,40 @@ unsigned VideoDataOutput::formatCallback(char *chroma,
                                          unsigned *pitches, unsigned *lines)
 {
     DEBUG_BLOCK;
+    QMutexLocker lock(&m_mutex);
 
     m_frame.width = *width;
     m_frame.height = *height;
 
     uint32_t fourcc = 0;
+    m_swapChromaPlanes = false;
 
     QSet<VideoFrame2::Format> allowedFormats = m_frontend->allowedFormats();
     VideoFrame2::Format suggestedFormat = fourccToFormat(chroma);
+    debug() << "decoder chroma" << chroma;
     if (suggestedFormat != VideoFrame2::Format_Invalid
             && allowedFormats.contains(suggestedFormat)) { // Use suggested
         fourcc = setFormat(suggestedFormat, &chroma);
         m_frame.format = suggestedFormat;
-    } else { // Pick first and use that
-        foreach (const VideoFrame2::Format &format, allowedFormats) {
+    } else if (isI420(chroma) && allowedFormats.contains(VideoFrame2::Format_YV12)) {
+        // Keep the decoder's chroma and merely hand VLC the chroma planes
+        // the other way around, no conversion needed.
+        fourcc = qstrcmp(chroma, "J420") == 0 ? VLC_CODEC_J420 : VLC_CODEC_I420;
+        m_frame.format = VideoFrame2::Format_YV12;
+        m_swapChromaPlanes = true;
+    } else {
+        // No way around a conversion, prefer the cheapest one.
+        QList<VideoFrame2::Format> preferredFormats;
+        if (isYuv(chroma)) {
+            preferredFormats << VideoFrame2::Format_YV12 << VideoFrame2::Format_YUY2
+                             << VideoFrame2::Format_RGB32 << VideoFrame2::Format_RGB888;
+        } else {
+            preferredFormats << VideoFrame2::Format_RGB32 << VideoFrame2::Format_RGB888
+                             << VideoFrame2::Format_YV12 << VideoFrame2::Format_YUY2;
+        }
+        foreach (const VideoFrame2::Format &format, preferredFormats) {
+            if (!allowedFormats.contains(format))
+                continue;
             fourcc = setFormat(format, &chroma);
             if (fourcc > 0) {
                 m_frame.format = format;
@@ -181,12 +325,23 @@ unsigned VideoDataOutput::formatCallback(char *chroma,
     }
 
     Q_ASSERT(fourcc > 0);
+    debug() << "delivering" << chroma << "as format" << m_frame.format;
 
     unsigned int bufferSize = setPitchAndLines(fourcc, *width, *height, pitches, lines);
 
-    m_frame.data0.resize(pitches[0] * lines[0]);
-    m_frame.data1.resize(pitches[1] * lines[1]);
-    m_frame.data2.resize(pitches[2] * lines[0]);
+    m_planeSizes[0] = pitches[0] * lines[0];
+    m_planeSizes[1] = pitches[1] * lines[1];
+    m_planeSizes[2] = pitches[2] * lines[2];
+
+    // Frames consumers still hold keep their memory, everything else is
+    // replaced for the new format.
+    m_frames.fill(Experimental::VideoFrame2(), m_framePoolSize);
+    for (int i = 0; i < m_frames.size(); ++i) {
+        allocateFrame(&m_frames[i]);
+    }
+    m_dropFrame = Experimental::VideoFrame2();
+    m_lockedFrame = 0;
+    m_nextFrame = 0;
 
     return bufferSize;
 }
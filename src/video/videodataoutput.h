@@ -20,6 +20,7 @@
 
 #include <QMutex>
 #include <QObject>
+#include <QVector>
 
 #include <phonon/experimental/videodataoutputinterface.h>
 #include <phonon/experimental/videoframe2.h>
@@ -33,6 +34,14 @@ namespace VLC
 {
 
 /**
+ * VLC decodes into a pool of frames, a frame is handed to the frontend when
+ * it is due for display. Frames share their planes implicitly, a consumer may
+ * keep a copy of a frame for as long as it likes without holding up decoding;
+ * the buffer simply is not reused until the last copy is gone.
+ *
+ * Should all frames of the pool be held by consumers, the decoded frame is
+ * either dropped (\c dropFramesWhenFull) or decoded into fresh memory.
+ *
  * @author Harald Sitter <apachelogger@ubuntu.com>
  */
 class VideoDataOutput : public QObject, public SinkNode,
@@ -40,6 +49,9 @@ class VideoDataOutput : public QObject, public SinkNode,
 {
     Q_OBJECT
     Q_INTERFACES(Phonon::Experimental::VideoDataOutputInterface)
+    Q_PROPERTY(int framePoolSize READ framePoolSize WRITE setFramePoolSize)
+    Q_PROPERTY(bool dropFramesWhenFull READ dropFramesWhenFull WRITE setDropFramesWhenFull)
+    Q_PROPERTY(int droppedFrames READ droppedFrames)
 public:
     explicit VideoDataOutput(QObject *parent);
     ~VideoDataOutput();
@@ -51,6 +63,16 @@ public:
     Experimental::AbstractVideoDataOutput *frontendObject() const override;
     void setFrontendObject(Experimental::AbstractVideoDataOutput *frontend) override;
 
+    /// \returns number of frames in the pool, takes effect on the next format change
+    int framePoolSize() const;
+    void setFramePoolSize(int size);
+
+    bool dropFramesWhenFull() const;
+    void setDropFramesWhenFull(bool drop);
+
+    /// \returns number of frames dropped because the pool was exhausted
+    int droppedFrames() const;
+
     void *lockCallback(void **planes) override;
     void unlockCallback(void *picture,void *const *planes) override;
     void displayCallback(void *picture) override;
@@ -62,10 +84,33 @@ public:
     void formatCleanUpCallback() override;
 
 private:
+    /**
+     * \returns a frame of the pool no one holds on to anymore.
+     * Must be called with m_mutex locked.
+     */
+    Experimental::VideoFrame2 *acquireFrame();
+
+    /// Gives \p frame freshly allocated planes for the current format.
+    void allocateFrame(Experimental::VideoFrame2 *frame) const;
+
     Experimental::AbstractVideoDataOutput *m_frontend;
+    /// Format of the frames, without planes.
     Experimental::VideoFrame2 m_frame;
+    int m_planeSizes[3];
+    /// Stable for as long as the format does not change.
+    QVector<Experimental::VideoFrame2> m_frames;
+    /// Frame decoded into when dropping.
+    Experimental::VideoFrame2 m_dropFrame;
+    /// Frame VLC currently decodes into.
+    Experimental::VideoFrame2 *m_lockedFrame;
+    int m_nextFrame;
+    int m_framePoolSize;
+    bool m_dropFramesWhenFull;
+    int m_droppedFrames;
+    /// VLC writes I420, whose chroma planes are in the opposite order of YV12.
+    bool m_swapChromaPlanes;
     QByteArray m_buffer;
-    QMutex m_mutex;
+    mutable QMutex m_mutex;
 };
 
 } // namespace VLC
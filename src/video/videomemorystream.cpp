@@ -52,6 +52,12 @@ unsigned VideoMemoryStream::setPitchAndLines(uint32_t fourcc,
         lines[i] = plane.i_visible_lines;
         bufferSize += (pitches[i] * lines[i]);
     }
+    // vmem hands us PICTURE_PLANE_MAX entries, make sure unused planes read as empty.
+    for (auto i = picture->i_planes; i < PICTURE_PLANE_MAX; ++i) {
+        pitches[i] = 0;
+        lines[i] = 0;
+    }
+    picture_Release(picture);
 
     return bufferSize;
 }
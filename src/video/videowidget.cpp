@@ -21,9 +21,12 @@
 
 #include "videowidget.h"
 
+#include <QAtomicInt>
 #include <QGuiApplication>
 #include <QPainter>
 #include <QPaintEvent>
+#include <QScreen>
+#include <QtMath>
 
 #include <vlc/vlc.h>
 
@@ -31,6 +34,7 @@
 #include "mediaobject.h"
 #include "media.h"
 
+#include "video/pixelconversion.h"
 #include "video/videomemorystream.h"
 
 namespace Phonon {
@@ -38,30 +42,131 @@ namespace VLC {
 
 #define DEFAULT_QSIZE QSize(320, 240)
 
+// Triple buffering: VLC writes one frame, the painter reads another and the
+// third holds the latest complete frame. Handing frames over is a single
+// atomic exchange of the latest index with either side's own index.
+#define SURFACE_FRAMES 3
+// Set in m_latest when the frame was not picked up by the painter yet.
+#define SURFACE_FRESH 0x4
+#define SURFACE_INDEX_MASK 0x3
+// Slack behind the planes, chroma reads of odd sized frames may overshoot a byte.
+#define SURFACE_PADDING 16
+
 class SurfacePainter : public VideoMemoryStream
 {
 public:
+    SurfacePainter()
+        : widget(0)
+        , m_writeIndex(0)
+        , m_latest(1)
+        , m_paintIndex(2)
+        , m_chromaStep(1)
+        , m_imageStale(true)
+        , m_hasFrame(false)
+        , m_targetWidth(0)
+        , m_targetHeight(0)
+        , m_paintPending(0)
+        , m_openOutputs(0)
+        , m_droppedFrames(0)
+        , m_paintedFrames(0)
+    {
+        for (int i = 0; i < SURFACE_FRAMES; ++i)
+            m_bits[i] = 0;
+        for (int i = 0; i < 3; ++i)
+            m_offsets[i] = m_pitches[i] = 0;
+    }
+
+    /**
+     * Sets the size in device pixels frames should be scaled down to at the
+     * next format negotiation, an empty size delivers frames at their native size.
+     */
+    void setTargetSize(const QSize &size)
+    {
+        m_targetWidth.storeRelease(size.width());
+        m_targetHeight.storeRelease(size.height());
+    }
+
+    /**
+     * \returns a copy of the newest frame, converted to RGB32 at its native
+     * size, or a null image if there is none yet or VLC scales the frames down
+     */
+    QImage snapshot()
+    {
+        QMutexLocker lock(&m_mutex);
+        // A downscaled frame would make a widget sized snapshot.
+        if (m_frameSize.isEmpty() || m_frameSize != m_sourceSize)
+            return QImage();
+
+        // Take the newest frame into painter ownership so VLC cannot write
+        // to it while we convert, the next paint picks it up from there.
+        if (m_latest.loadAcquire() & SURFACE_FRESH) {
+            m_paintIndex = m_latest.fetchAndStoreOrdered(m_paintIndex) & SURFACE_INDEX_MASK;
+            m_imageStale = true;
+            m_hasFrame = true;
+        }
+        // The frames are merely black until VLC delivered the first one.
+        if (!m_hasFrame)
+            return QImage();
+
+        QImage image(m_frameSize, QImage::Format_RGB32);
+        const uchar *frame = m_bits[m_paintIndex];
+        convertYuv420ToRgb32(frame + m_offsets[0], m_pitches[0],
+                             frame + m_offsets[1], frame + m_offsets[2], m_pitches[1], m_chromaStep,
+                             m_frameSize.width(), m_frameSize.height(),
+                             image.bits(), image.bytesPerLine(), image.width(), image.height());
+        return image;
+    }
+
+    /// \returns number of frames replaced by a newer one before they got painted
+    int droppedFrames() const { return m_droppedFrames.loadRelaxed(); }
+
+    /// \returns number of frames painted
+    int paintedFrames() const { return m_paintedFrames.loadRelaxed(); }
+
     void handlePaint(QPaintEvent *event)
     {
-        // Mind that locking here is still faster than making this lockfree by
-        // dispatching QEvents.
-        // Plus VLC can actually skip frames as necessary.
+        // VLC never takes the mutex for a frame, it only guards against the
+        // frames being reallocated by a format change.
         QMutexLocker lock(&m_mutex);
         Q_UNUSED(event);
 
-        if (m_frame.isNull()) {
+        // Frames published from now on need another update.
+        m_paintPending.storeRelease(0);
+        if (m_latest.loadAcquire() & SURFACE_FRESH) {
+            m_paintIndex = m_latest.fetchAndStoreOrdered(m_paintIndex) & SURFACE_INDEX_MASK;
+            m_imageStale = true;
+            m_hasFrame = true;
+            m_paintedFrames.ref();
+        }
+        if (m_frameSize.isEmpty()) {
             return;
         }
 
+        // Convert and scale straight to the size we paint at, in device
+        // pixels, so QPainter merely has to blit. Repaints without a new
+        // frame (e.g. expose events) reuse the last conversion.
+        const QRect rect = drawFrameRect();
+        const QSize size = rect.size() * widget->devicePixelRatioF();
+        if (size.isEmpty()) {
+            return;
+        }
+        if (m_image.size() != size) {
+            m_image = QImage(size, QImage::Format_RGB32);
+            m_imageStale = true;
+        }
+        if (m_imageStale) {
+            // bits() bumps the cacheKey, so paint engines caching textures
+            // (i.e. OpenGL) notice the change.
+            const uchar *frame = m_bits[m_paintIndex];
+            convertYuv420ToRgb32(frame + m_offsets[0], m_pitches[0],
+                                 frame + m_offsets[1], frame + m_offsets[2], m_pitches[1], m_chromaStep,
+                                 m_frameSize.width(), m_frameSize.height(),
+                                 m_image.bits(), m_image.bytesPerLine(), m_image.width(), m_image.height());
+            m_imageStale = false;
+        }
+
         QPainter painter(widget);
-        // When using OpenGL for the QPaintEngine drawing the same QImage twice
-        // does not actually result in a texture change for one reason or another.
-        // So we simply create new images for every event. This is plenty cheap
-        // as the QImage only points to the plane data (it can't even make it
-        // properly shared as it does not know that the data belongs to a QBA).
-        // TODO: investigate if this is still necessary. This was added for gwenview, but with Qt 5.15 the problem
-        //   can't be produced.
-        painter.drawImage(drawFrameRect(), QImage(m_frame));
+        painter.drawImage(rect, m_image);
         event->accept();
     }
 
@@ -70,8 +175,10 @@ public:
 private:
     void *lockCallback(void **planes) override
     {
-        m_mutex.lock();
-        planes[0] = (void *) m_frame.bits();
+        // The write frame belongs to VLC alone, no locking needed.
+        uchar *frame = m_bits[m_writeIndex];
+        for (int i = 0; i < 3; ++i)
+            planes[i] = frame + m_offsets[i];
         return 0;
     }
 
@@ -79,13 +186,23 @@ private:
     {
         Q_UNUSED(picture);
         Q_UNUSED(planes);
-        m_mutex.unlock();
     }
 
     void displayCallback(void *picture) override
     {
         Q_UNUSED(picture);
-        if (widget)
+        // Publish the frame now that it is due and continue in whatever frame
+        // was latest before. Should the painter not have picked that one up,
+        // i.e. when frames come in faster than the screen refreshes, it gets
+        // dropped by decoding the next frame into it.
+        const int previous = m_latest.fetchAndStoreOrdered(m_writeIndex | SURFACE_FRESH);
+        m_writeIndex = previous & SURFACE_INDEX_MASK;
+        if (previous & SURFACE_FRESH)
+            m_droppedFrames.ref();
+
+        // The update still pending paints this frame just as well, there is
+        // no need to queue another one for every frame.
+        if (widget && m_paintPending.testAndSetOrdered(0, 1))
             widget->update();
     }
 
@@ -95,35 +212,69 @@ private:
                                     unsigned *lines) override
     {
         QMutexLocker lock(&m_mutex);
-        // Surface rendering is a fallback system used when no efficient rendering implementation is available.
-        // As such we only support RGB32 for simplicity reasons and this will almost always mean software scaling.
-        // And since scaling is unavoidable anyway we take the canonical frame size and then scale it on our end via
-        // QPainter, again, greater simplicity at likely no real extra cost since this is all super inefficient anyway.
-        // Also, since aspect ratio can be change mid-playback by the user, doing the scaling on our end means we
+        m_openOutputs.ref();
+        // Surface rendering is the main rendering path where VLC cannot render into the window itself (e.g. on
+        // Wayland). We take YUV 4:2:0, which is what decoders generally produce, so VLC needs no colour conversion,
+        // and convert it ourselves when painting, fused with scaling to the paint size (see pixelconversion.h).
+        // NV12 is taken as is, anything else gets converted to I420 by VLC.
+        // Since aspect ratio can be changed mid-playback by the user, doing the scaling on our end means we
         // don't need to restart the entire player to retrigger format calculation.
-        // With all that in mind we simply use the canonical size and feed VLC the QImage's pitch and lines as
-        // effectively the VLC vout is the QImage so its constraints matter.
 
-        // per https://wiki.videolan.org/Hacker_Guide/Video_Filters/#Pitch.2C_visible_pitch.2C_planes_et_al.
-        // it would seem that we can use either real or visible pitches and lines as VLC generally will iterate the
-        // smallest value when moving data between two entities. i.e. since QImage will at most paint NxM anyway,
-        // we may just go with its values as calculating the real pitch/line of the VLC picture_t for RV32 wouldn't
-        // change the maximum pitch/lines we can paint on the output side.
+        // Optionally VLC scales down to what we will paint anyway, that is
+        // much cheaper on its thread than for every paint on ours. See
+        // VideoWidget::setSurfaceDownscaling().
+        m_sourceSize = QSize(*width, *height);
+        const QSize size = scaledSize(m_sourceSize,
+                                      QSize(m_targetWidth.loadAcquire(), m_targetHeight.loadAcquire()));
+        if (size != m_sourceSize) {
+            debug() << "scaling surface from" << m_sourceSize << "to" << size;
+            *width = size.width();
+            *height = size.height();
+        }
 
-        qstrcpy(chroma, "RV32");
-        m_frame = QImage(*width, *height, QImage::Format_RGB32);
-        Q_ASSERT(!m_frame.isNull()); // ctor may construct null if allocation fails
-        m_frame.fill(0);
-        pitches[0] = m_frame.bytesPerLine();
-        lines[0] = m_frame.sizeInBytes() / m_frame.bytesPerLine();
+        const bool nv12 = qstrcmp(chroma, "NV12") == 0;
+        qstrcpy(chroma, nv12 ? "NV12" : "I420");
+        const unsigned bufferSize = setPitchAndLines(nv12 ? VLC_CODEC_NV12 : VLC_CODEC_I420,
+                                                     *width, *height, pitches, lines);
+
+        const int lumaSize = pitches[0] * lines[0];
+        m_offsets[0] = 0;
+        m_offsets[1] = lumaSize;
+        m_pitches[0] = pitches[0];
+        m_pitches[1] = m_pitches[2] = pitches[1];
+        if (nv12) {
+            // U and V are interleaved in the second plane.
+            m_offsets[2] = m_offsets[1] + 1;
+            m_chromaStep = 2;
+        } else {
+            m_offsets[2] = m_offsets[1] + pitches[1] * lines[1];
+            m_chromaStep = 1;
+        }
 
-        return  m_frame.sizeInBytes();
+        for (int i = 0; i < SURFACE_FRAMES; ++i) {
+            m_frames[i] = QByteArray(bufferSize + SURFACE_PADDING, Qt::Uninitialized);
+            // Black until VLC delivers.
+            memset(m_frames[i].data(), 16, lumaSize);
+            memset(m_frames[i].data() + lumaSize, 128, m_frames[i].size() - lumaSize);
+            m_bits[i] = reinterpret_cast<uchar *>(m_frames[i].data());
+        }
+        m_writeIndex = 0;
+        m_latest.storeRelease(1);
+        m_paintIndex = 2;
+        m_frameSize = QSize(*width, *height);
+        m_image = QImage();
+        m_imageStale = true;
+        m_hasFrame = false;
+
+        return bufferSize;
     }
 
     void formatCleanUpCallback() override
     {
         // Lazy delete the object to avoid callbacks from VLC after deletion.
-        if (!widget) {
+        // During a crossfade the output of the fading player may close while
+        // the one of the next player is already open, the last one deletes.
+        if (!m_openOutputs.deref() && !widget) {
             // The widget member is set to null by the widget destructor, so when this condition is true the
             // widget had already been destroyed and we can't possibly receive a paint event anymore, meaning
             // we need no lock here. If it were any other way we'd have trouble with synchronizing deletion
@@ -132,6 +283,22 @@ private:
         }
     }
 
+    /**
+     * \returns \p source scaled down so that it still covers \p target,
+     * never scaled up.
+     */
+    static QSize scaledSize(const QSize &source, const QSize &target)
+    {
+        if (target.isEmpty() || source.isEmpty())
+            return source;
+        const qreal factor = qMax(qreal(target.width()) / source.width(),
+                                  qreal(target.height()) / source.height());
+        if (factor >= 1.0)
+            return source;
+        return QSize(qMax(1, qCeil(source.width() * factor)),
+                     qMax(1, qCeil(source.height() * factor)));
+    }
+
     QRect scaleToAspect(QRect srcRect, int w, int h) const
     {
         float width = srcRect.width();
@@ -159,7 +326,7 @@ private:
             drawFrameRect = scaleToAspect(widgetRect, 16, 9);
             break;
         case Phonon::VideoWidget::AspectRatioAuto:
-            drawFrameRect = QRect(0, 0, m_frame.width(), m_frame.height());
+            drawFrameRect = QRect(0, 0, m_frameSize.width(), m_frameSize.height());
             break;
         }
 
@@ -190,8 +357,35 @@ private:
         return drawFrameRect;
     }
 
-    // Could ReadWriteLock two frames so VLC can write while we paint.
-    QImage m_frame;
+    QByteArray m_frames[SURFACE_FRAMES];
+    uchar *m_bits[SURFACE_FRAMES];
+    /// Layout of the Y, U and V planes within a frame.
+    int m_offsets[3];
+    int m_pitches[3];
+    int m_chromaStep;
+    QSize m_frameSize;
+    /// Owned by VLC's vout thread.
+    int m_writeIndex;
+    /// Index of the latest complete frame, possibly flagged SURFACE_FRESH.
+    QAtomicInt m_latest;
+    /// Owned by the GUI thread.
+    int m_paintIndex;
+    /// Last frame converted for painting, owned by the GUI thread.
+    QImage m_image;
+    bool m_imageStale;
+    /// Whether the painter took in a frame VLC delivered since the last format negotiation.
+    bool m_hasFrame;
+    /// Native size of the video as of the last format negotiation.
+    QSize m_sourceSize;
+    /// See setTargetSize(), read by the vout thread.
+    QAtomicInt m_targetWidth;
+    QAtomicInt m_targetHeight;
+    /// Set while an update() was requested but not painted yet.
+    QAtomicInt m_paintPending;
+    /// Number of video outputs negotiated but not cleaned up yet.
+    QAtomicInt m_openOutputs;
+    QAtomicInt m_droppedFrames;
+    QAtomicInt m_paintedFrames;
     QMutex m_mutex;
 };
 
@@ -206,8 +400,12 @@ VideoWidget::VideoWidget(QWidget *parent) :
     m_contrast(0.0),
     m_hue(0.0),
     m_saturation(0.0),
-    m_surfacePainter(0)
+    m_surfacePainter(0),
+    m_surfaceDownscaling(false)
 {
+    connect(qApp, SIGNAL(screenAdded(QScreen*)), SLOT(updateSurfaceSize()));
+    connect(qApp, SIGNAL(screenRemoved(QScreen*)), SLOT(updateSurfaceSize()));
+
     // We want background painting so Qt autofills with black.
     setAttribute(Qt::WA_NoSystemBackground, false);
 
@@ -240,6 +438,10 @@ void VideoWidget::handleConnectToMediaObject(MediaObject *mediaObject)
             SLOT(clearPendingAdjusts()));
 
     clearPendingAdjusts();
+
+    // The MediaObject moved us over to a new player (e.g. for a crossfade).
+    if (m_surfacePainter)
+        m_surfacePainter->setCallbacks(m_player);
 }
 
 void VideoWidget::handleDisconnectFromMediaObject(MediaObject *mediaObject)
@@ -247,6 +449,10 @@ void VideoWidget::handleDisconnectFromMediaObject(MediaObject *mediaObject)
     // Undo all connections or path creation->destruction->creation can cause
     // duplicated connections or getting signals from two different MediaObjects.
     disconnect(mediaObject, 0, this, 0);
+
+    // Video outputs the player opens from now on must not draw into us.
+    if (m_surfacePainter && m_player)
+        m_surfacePainter->unsetCallbacks(m_player);
 }
 
 void VideoWidget::handleAddToMedia(Media *media)
@@ -472,6 +678,49 @@ void VideoWidget::paintEvent(QPaintEvent *event)
         m_surfacePainter->handlePaint(event);
 }
 
+int VideoWidget::droppedFrames() const
+{
+    return m_surfacePainter ? m_surfacePainter->droppedFrames() : 0;
+}
+
+int VideoWidget::paintedFrames() const
+{
+    return m_surfacePainter ? m_surfacePainter->paintedFrames() : 0;
+}
+
+bool VideoWidget::surfaceDownscaling() const
+{
+    return m_surfaceDownscaling;
+}
+
+void VideoWidget::setSurfaceDownscaling(bool enabled)
+{
+    if (m_surfaceDownscaling == enabled)
+        return;
+    m_surfaceDownscaling = enabled;
+    updateSurfaceSize();
+}
+
+void VideoWidget::updateSurfaceSize()
+{
+    if (!m_surfacePainter)
+        return;
+
+    // The size only gets negotiated when the video output opens, i.e. at
+    // the start of a media, renegotiating would restart the decoder. The
+    // widget can grow up to a full screen meanwhile, so that is the size
+    // frames get scaled down to.
+    QSize size;
+    if (m_surfaceDownscaling) {
+        foreach (const QScreen *screen, QGuiApplication::screens())
+            size = size.expandedTo(screen->size() * screen->devicePixelRatio());
+    }
+    if (size == m_surfaceSize)
+        return;
+    m_surfaceSize = size;
+    m_surfacePainter->setTargetSize(size);
+}
+
 bool VideoWidget::enableFilterAdjust(bool adjust)
 {
     DEBUG_BLOCK;
@@ -523,6 +772,14 @@ float VideoWidget::phononRangeToVlcRange(qreal phononValue, float upperBoundary,
 QImage VideoWidget::snapshot() const
 {
     DEBUG_BLOCK;
+    // When painting ourselves the frame is right here, no need to have VLC
+    // encode and write it to a file that we then decode again. That is
+    // unless there is no frame yet or only a downscaled one.
+    if (m_surfacePainter) {
+        const QImage image = m_surfacePainter->snapshot();
+        if (!image.isNull())
+            return image;
+    }
     if (m_player)
         return m_player->snapshot();
     else
@@ -539,6 +796,7 @@ void VideoWidget::enableSurfacePainter()
     m_surfacePainter = new SurfacePainter;
     m_surfacePainter->widget = this;
     m_surfacePainter->setCallbacks(m_player);
+    updateSurfaceSize();
 }
 
 } // namespace VLC
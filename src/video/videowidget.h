@@ -50,6 +50,9 @@ class VideoWidget : public BaseWidget, public SinkNode, public VideoWidgetInterf
 {
     Q_OBJECT
     Q_INTERFACES(Phonon::VideoWidgetInterface44)
+    Q_PROPERTY(bool surfaceDownscaling READ surfaceDownscaling WRITE setSurfaceDownscaling)
+    Q_PROPERTY(int droppedFrames READ droppedFrames)
+    Q_PROPERTY(int paintedFrames READ paintedFrames)
 public:
     /**
      * Constructs a new VideoWidget with the given parent. The video settings members
@@ -156,6 +159,30 @@ public:
 
     void setVisible(bool visible) override;
 
+    /**
+     * \returns whether frames painted by the surface painter are scaled down
+     * to the widget's size by VLC rather than while painting
+     */
+    bool surfaceDownscaling() const;
+
+    /**
+     * \returns number of frames the surface painter skipped because newer
+     * ones arrived before they could be painted (0 if not painting ourselves)
+     */
+    int droppedFrames() const;
+
+    /// \returns number of frames the surface painter painted
+    int paintedFrames() const;
+
+    /**
+     * When painting frames ourselves (i.e. when VLC cannot render into the
+     * window directly) VLC delivers the video at its native size by default,
+     * which is then scaled for every paint on the GUI thread.
+     * With downscaling enabled VLC instead scales frames larger than the
+     * largest screen down to it, starting with the next media.
+     */
+    void setSurfaceDownscaling(bool enabled);
+
 private Q_SLOTS:
     /// Updates the sizeHint to match the native size of the video.
     /// \param hasVideo \c true when there is a video, \c false otherwise
@@ -174,6 +201,9 @@ private Q_SLOTS:
      */
     void clearPendingAdjusts();
 
+    /// Hands the size frames get scaled down to to the surface painter.
+    void updateSurfaceSize();
+
 protected:
     /// \reimp
     void paintEvent(QPaintEvent *event) override;
@@ -245,6 +275,10 @@ private:
     qreal m_saturation;
 
     SurfacePainter *m_surfacePainter;
+
+    bool m_surfaceDownscaling;
+    /// Size in device pixels last handed to the surface painter.
+    QSize m_surfaceSize;
 };
 
 } // namespace VLC